@@ -77,7 +77,8 @@ def create_xml(map_data, output_file_path, width, height, robot_init_pos):
     
     tree.write(output_file_path, encoding='utf-8', xml_declaration=True)
 
-def create_Argos(map_data, output_file_path, width, height, robot_init_pos, curr_num_agent, port_num, visualization=False):
+def create_Argos(map_data, output_file_path, width, height, robot_init_pos, curr_num_agent, port_num, visualization=False,
+                 macro_actions=False, batch_steps=False):
     # Create the root element
     argos_config = ET.Element("argos-configuration")
 
@@ -120,7 +121,8 @@ def create_Argos(map_data, output_file_path, width, height, robot_init_pos, curr
     positioning = ET.SubElement(sensors, "positioning", implementation="default")
 
     # Parameters
-    params = ET.SubElement(footbot_controller, "params", alpha="7.5", omega="1.57", velocity="2.0", acceleration="0.5", portNumber=f"{port_num}", outputDir=f"metaData{port_num}/")
+    params = ET.SubElement(footbot_controller, "params", alpha="7.5", omega="1.57", velocity="2.0", acceleration="0.5", portNumber=f"{port_num}", outputDir=f"metaData{port_num}/",
+                           macroActions=str(macro_actions).lower(), batchSteps=str(batch_steps).lower())
 
     map_center_x = -height / 2+0.5
     map_center_y = -width / 2+0.5
@@ -0,0 +1,42 @@
+import argparse
+import json
+import os
+import subprocess
+import tempfile
+import time
+
+
+def parse_arguments():
+    parser = argparse.ArgumentParser(description="RPC throughput of the ADG server for different worker counts.")
+    parser.add_argument("--path_filename", type=str, required=True, help="Name of the path file the server runs")
+    parser.add_argument("--flip_coord", type=int, required=False, default=True, help="input format of the mapf planner, 0 if xy, 1 if yx")
+    parser.add_argument("--port_num", type=int, required=False, default=8182, help="Port number for the server")
+    parser.add_argument("--workers", type=str, required=False, default="1,2,4,8,32", help="Comma separated numbers of RPC workers to run")
+    parser.add_argument("--clients", type=int, required=False, default=32, help="Number of client threads, 32 as ARGoS")
+    return parser.parse_args()
+
+
+def run_once(args, workers, stats_filename):
+    server_command = ["build/server/ADG_server", "-p", args.path_filename, "-n", str(args.port_num),
+                      "-o", stats_filename, f"--flip_coord={args.flip_coord}", f"--rpc_workers={workers}"]
+    bench_command = ["build/server/rpc_throughput", "-p", args.path_filename, "-n", str(args.port_num),
+                     f"--flip_coord={args.flip_coord}", f"--clients={args.clients}"]
+    server_process = subprocess.Popen(server_command, stdout=subprocess.DEVNULL)
+    time.sleep(1)
+    result = subprocess.run(bench_command, capture_output=True, text=True, check=True)
+    server_process.wait()
+    return json.loads(result.stdout.strip().splitlines()[-1])
+
+
+if __name__ == "__main__":
+    args = parse_arguments()
+    if not os.path.exists(args.path_filename):
+        print(f"{args.path_filename} not exists!")
+        exit(-1)
+    with tempfile.TemporaryDirectory() as stats_dir:
+        stats_filename = os.path.join(stats_dir, "stats.csv")
+        print("workers,clients,calls,seconds,calls per second")
+        for workers in [int(w) for w in args.workers.split(",")]:
+            result = run_once(args, workers, stats_filename)
+            print(f"{workers},{result['clients']},{result['calls']},{result['seconds']:.3f},"
+                  f"{result['calls per second']:.0f}")
@@ -2,6 +2,7 @@
 #include <argos3/core/utility/configuration/argos_configuration.h>
 #include <argos3/core/utility/math/vector2.h>
 #include <argos3/core/utility/math/vector3.h>
+#include <argos3/core/simulator/simulator.h>
 #include <rpc/client.h>
 
 
@@ -20,6 +21,7 @@ void CFootBotDiffusion::insertActions(std::vector<outputTuple> actions)
     for (const auto &action: actions) {
         std::string action1 = std::get<3>(action);
         int nodeID = std::get<1>(action);
+        std::tuple<double, double> start_pos = std::get<4>(action);
         std::tuple<double, double> end_pos = std::get<5>(action);
         double x = ChangeCoordinateFromMapToArgos(std::get<1>(end_pos));
         double y = ChangeCoordinateFromMapToArgos(std::get<0>(end_pos));
@@ -36,14 +38,19 @@ void CFootBotDiffusion::insertActions(std::vector<outputTuple> actions)
         if (robot_id == debug_id) {
             std::cout << "Action: " << action1 << " NodeID: " << nodeID << " End Position: " << x << " " << y << " Angle: " << angle << std::endl;
         }
-        if (action1 == "M") {
+        if (action1 == "M" or action1 == "R") {
+            bool reverse = action1 == "R";
             std::deque<int> prev_ids;
-            if (not q.empty() and q.back().type == Action::MOVE) {
+            std::deque<Real> prev_lengths;
+            if (not q.empty() and q.back().type == Action::MOVE and q.back().reverse == reverse) {
                 prev_ids = q.back().nodeIDS;
+                prev_lengths = q.back().nodeLengths;
                 q.pop_back();
             }
             prev_ids.push_back(nodeID);
-            q.push_back({x, y, angle, prev_ids, Action::MOVE});
+            prev_lengths.push_back(std::hypot(std::get<0>(end_pos) - std::get<0>(start_pos),
+                                              std::get<1>(end_pos) - std::get<1>(start_pos)));
+            q.push_back({x, y, angle, prev_ids, Action::MOVE, prev_lengths, reverse});
         } else if (action1 == "T") {
             q.push_back({x, y, angle, std::deque<int>{nodeID}, Action::TURN});
         } else {
@@ -52,6 +59,109 @@ void CFootBotDiffusion::insertActions(std::vector<outputTuple> actions)
     }
 }
 
+std::vector<outputTuple> CFootBotDiffusion::requestActions(const std::string& method) {
+    if (not m_macroActions) {
+        return client->call(method, robot_id).as<std::vector<outputTuple>>();
+    }
+    // A segment is one node to the controller: confirming its last node confirms the whole run.
+    std::vector<outputTuple> actions;
+    for (const auto& segment: client->call(method + "_macro", robot_id).as<std::vector<macroTuple>>()) {
+        actions.emplace_back(std::get<0>(segment), std::get<2>(segment), std::get<3>(segment), std::get<4>(segment),
+                             std::get<5>(segment), std::get<6>(segment));
+    }
+    return actions;
+}
+
+std::string CFootBotDiffusion::acknowledge(int node_id) {
+    if (m_batchSteps) {
+        // Confirming a node confirms every node before it, so only the last one is sent.
+        m_ackNode = node_id;
+        return "";
+    }
+    return client->call("receive_update", robot_id, node_id).as<std::string>();
+}
+
+StepBatch& StepBatch::instance(int port_number) {
+    static StepBatch batch(port_number);
+    return batch;
+}
+
+StepBatch::StepBatch(int port_number): client(std::make_shared<rpc::client>("127.0.0.1", port_number)) {}
+
+void StepBatch::join(UInt32 tick) {
+    std::unique_lock<std::mutex> lock(mutex);
+    startTick(tick);
+    // The robot does not post in its init tick, so joining counts as its empty post for that tick.
+    num_robots++;
+    countPost(lock);
+}
+
+void StepBatch::post(const std::string& robot_id, int ack_node, int ack_step, bool request, UInt32 tick) {
+    std::unique_lock<std::mutex> lock(mutex);
+    startTick(tick);
+    if (ack_node >= 0) {
+        acks.emplace_back(robot_id, ack_node, ack_step);
+    }
+    if (request) {
+        requests.push_back(robot_id);
+    }
+    countPost(lock);
+}
+
+void StepBatch::startTick(UInt32 tick) {
+    if (tick != current_tick) {
+        current_tick = tick;
+        posted = 0;
+    }
+}
+
+void StepBatch::countPost(std::unique_lock<std::mutex>& lock) {
+    // Robots joining later in the tick raise both counts again, and send an empty step.
+    if (++posted < num_robots) {
+        return;
+    }
+    if (acks.empty() and requests.empty()) {
+        return;
+    }
+    // Every robot posted for this step, so the blocking call does not need the lock.
+    std::vector<std::tuple<std::string, int, int>> step_acks;
+    std::vector<std::string> step_requests;
+    step_acks.swap(acks);
+    step_requests.swap(requests);
+    lock.unlock();
+    auto result = client->call("step", step_acks, step_requests).as<std::pair<std::map<std::string, std::string>,
+                                                                              std::vector<outputTuple>>>();
+    lock.lock();
+    for (const auto& [robot_id, reply]: result.first) {
+        replies[robot_id] = reply;
+    }
+    for (const auto& action: result.second) {
+        released[std::get<0>(action)].push_back(action);
+    }
+}
+
+std::string StepBatch::takeReply(const std::string& robot_id) {
+    std::lock_guard<std::mutex> guard(mutex);
+    auto reply = replies.find(robot_id);
+    if (reply == replies.end()) {
+        return "";
+    }
+    std::string msg = reply->second;
+    replies.erase(reply);
+    return msg;
+}
+
+std::vector<outputTuple> StepBatch::takeActions(const std::string& robot_id) {
+    std::lock_guard<std::mutex> guard(mutex);
+    auto actions = released.find(robot_id);
+    if (actions == released.end()) {
+        return {};
+    }
+    std::vector<outputTuple> taken = std::move(actions->second);
+    released.erase(actions);
+    return taken;
+}
+
 void CFootBotDiffusion::Init(TConfigurationNode &t_node) {
     m_pcWheels = GetActuator<CCI_DifferentialSteeringActuator>("differential_steering");
     m_pcProximity = GetSensor<CCI_FootBotProximitySensor>("footbot_proximity");
@@ -66,6 +176,8 @@ void CFootBotDiffusion::Init(TConfigurationNode &t_node) {
     GetNodeAttributeOrDefault(t_node, "acceleration", m_linearAcceleration, m_linearAcceleration);
     GetNodeAttributeOrDefault(t_node, "portNumber", port_number, 8080);
     GetNodeAttributeOrDefault(t_node, "outputDir", m_outputDir,std::string("metaData/"));
+    GetNodeAttributeOrDefault(t_node, "macroActions", m_macroActions, false);
+    GetNodeAttributeOrDefault(t_node, "batchSteps", m_batchSteps, false);
     m_rotateWheelVelocity = 0.144 * m_angularVelocity / 2; // Convert from rad/s to m/s
     m_currVelocity = 0.0;
     CVector3 currPos = m_pcPosSens->GetReading().Position;
@@ -111,12 +223,14 @@ void CFootBotDiffusion::updateQueue() {
     auto first_act = q.front();
     if (first_act.type == Action::MOVE) {
         q.pop_front();
-        while (not q.empty() and q.front().type == Action::MOVE) {
+        while (not q.empty() and q.front().type == Action::MOVE and q.front().reverse == first_act.reverse) {
             auto next_act = q.front();
             q.pop_front();
             first_act.x = next_act.x;
             first_act.y = next_act.y;
             first_act.nodeIDS.insert(first_act.nodeIDS.end(), next_act.nodeIDS.begin(), next_act.nodeIDS.end());
+            first_act.nodeLengths.insert(first_act.nodeLengths.end(), next_act.nodeLengths.begin(),
+                                         next_act.nodeLengths.end());
         }
         q.push_front(first_act);
     }
@@ -131,8 +245,11 @@ void CFootBotDiffusion::ControlStep() {
         }
         is_initialized = true;
 
-        std::vector<outputTuple> actions = client->call("init", robot_id).as<std::vector<outputTuple>>();
+        std::vector<outputTuple> actions = requestActions("init");
         insertActions(actions);
+        if (m_batchSteps) {
+            StepBatch::instance(port_number).join(CSimulator::GetInstance().GetSpace().GetSimulationClock());
+        }
         return;
     }
     Action a;
@@ -146,8 +263,14 @@ void CFootBotDiffusion::ControlStep() {
     }
     Real left_v, right_v;
     CVector3 currPos = m_pcPosSens->GetReading().Position;
-    if (count % 10 == 0) {
-        std::vector<outputTuple> updateActions = client->call("update", robot_id).as<std::vector<outputTuple>>();
+    bool request_plan = count % 10 == 0;
+    std::string batch_reply;
+    if (m_batchSteps) {
+        // The answers to what this robot posted in its previous control step.
+        insertActions(StepBatch::instance(port_number).takeActions(robot_id));
+        batch_reply = StepBatch::instance(port_number).takeReply(robot_id);
+    } else if (request_plan) {
+        std::vector<outputTuple> updateActions = requestActions("update");
         if (updateActions.size() != 0) {
             insertActions(updateActions);
         }
@@ -164,11 +287,12 @@ void CFootBotDiffusion::ControlStep() {
             a.type = Action::STOP;
             q.pop_front();
             for (auto tmp_nodeId: a.nodeIDS) {
-                receive_msg = client->call("receive_update", robot_id, tmp_nodeId).as<std::string>();
+                receive_msg = acknowledge(tmp_nodeId);
             }
             continue;
         }
-        else if (a.type == Action::MOVE && ((currPos - targetPos).Length() + MOVE_DIS*(-static_cast<double>(a.nodeIDS.size()) + 1)) < EPS) {
+        else if (a.type == Action::MOVE && ((currPos - targetPos).Length() - (std::accumulate(a.nodeLengths.begin(),
+                     a.nodeLengths.end(), 0.0) - a.nodeLengths.front())) < EPS) {
             if (robot_id == debug_id) {
                 std::cout << "Action: " << a.type << ", Target Position: (" << a.x << ", " << a.y << ")" <<
                 ", Current Position: (" << currPos.GetX() << ", " << currPos.GetY() << "). Previous speed is: "
@@ -179,15 +303,16 @@ void CFootBotDiffusion::ControlStep() {
                     }
             }
             if (a.nodeIDS.size() > 1) {
-                receive_msg = client->call("receive_update", robot_id, a.nodeIDS.front()).as<std::string>();
+                receive_msg = acknowledge(a.nodeIDS.front());
                 q.front().nodeIDS.pop_front();
+                q.front().nodeLengths.pop_front();
             }
             if ((currPos - targetPos).Length() < EPS) {
                 if ((abs(prevVelocity_)) <= dt*m_fWheelVelocity) {
                     a.type = Action::STOP;
                     q.pop_front();
                     for (auto tmp_nodeId: a.nodeIDS) {
-                        receive_msg = client->call("receive_update", robot_id, tmp_nodeId).as<std::string>();
+                        receive_msg = acknowledge(tmp_nodeId);
                     }
                     continue;
                 }
@@ -195,7 +320,7 @@ void CFootBotDiffusion::ControlStep() {
         }
         else if (a.type == Action::TURN && angleDifference(currAngle, a.angle) < 0.1f) {
             a.type = Action::STOP;
-            receive_msg = client->call("receive_update", robot_id, a.nodeIDS.front()).as<std::string>();
+            receive_msg = acknowledge(a.nodeIDS.front());
             q.pop_front();
             continue;
         }
@@ -219,7 +344,13 @@ void CFootBotDiffusion::ControlStep() {
         right_v = 0.0f;
     }
 
-    if (receive_msg == "end" || receive_msg == "exit") {
+    if (m_batchSteps) {
+        // The server records the finish step from the acknowledgement itself.
+        StepBatch::instance(port_number).post(robot_id, m_ackNode, count, request_plan,
+                                              CSimulator::GetInstance().GetSpace().GetSimulationClock());
+        m_ackNode = -1;
+        receive_msg = batch_reply;
+    } else if (receive_msg == "end" || receive_msg == "exit") {
         client->call("update_finish_agent", robot_id, count);
     }
     if (receive_msg == "exit") {
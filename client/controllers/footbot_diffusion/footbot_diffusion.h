@@ -11,7 +11,10 @@
 #include <argos3/plugins/robots/foot-bot/control_interface/ci_footbot_turret_actuator.h>
 #include <argos3/plugins/robots/generic/control_interface/ci_positioning_sensor.h>
 #include <queue>
+#include <numeric>
+#include <cmath>
 #include <map>
+#include <mutex>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -27,9 +30,45 @@
 
 using namespace argos;
 using outputTuple = std::tuple<std::string, int, double, std::string, std::pair<double, double>, std::pair<double, double>>;
+// As outputTuple with the first and last node id of a straight run of moves.
+using macroTuple = std::tuple<std::string, int, int, double, std::string, std::pair<double, double>, std::pair<double, double>>;
 
 #define EPS 0.02f
-#define MOVE_DIS 0.5f
+
+/*
+ * Acknowledgements and plan requests of all robots in this process, sent as one step RPC per tick.
+ * Every joined robot posts once per control step; the last one to post sends the batch. Replies and
+ * released actions are taken by each robot on its next control step.
+ */
+class StepBatch {
+public:
+    static StepBatch& instance(int port_number);
+    // Adds a robot in its init tick, counting as its post for that tick; it posts once every later tick.
+    // tick is the simulation clock, which tells where one tick's posts end.
+    void join(UInt32 tick);
+    // ack_node is the last node finished in this step, -1 for none; ack_step is the step it finished at.
+    void post(const std::string& robot_id, int ack_node, int ack_step, bool request, UInt32 tick);
+    // Reply to the last acknowledgement of robot_id, empty if none arrived since the last call.
+    std::string takeReply(const std::string& robot_id);
+    std::vector<outputTuple> takeActions(const std::string& robot_id);
+
+private:
+    explicit StepBatch(int port_number);
+    // Starts counting posts again when tick is a new one.
+    void startTick(UInt32 tick);
+    // Sends the step once every robot posted, with the lock released during the call.
+    void countPost(std::unique_lock<std::mutex>& lock);
+
+    std::mutex mutex;
+    std::shared_ptr<rpc::client> client;
+    int num_robots = 0;
+    int posted = 0;
+    UInt32 current_tick = 0;
+    std::vector<std::tuple<std::string, int, int>> acks;
+    std::vector<std::string> requests;
+    std::map<std::string, std::string> replies;
+    std::map<std::string, std::vector<outputTuple>> released;
+};
 
 struct Action {
     Real x;
@@ -41,6 +80,10 @@ struct Action {
         TURN,
         STOP
     } type;
+    // Length of each node of a move, in the order of nodeIDS; moves may be split into any number of nodes.
+    std::deque<Real> nodeLengths;
+    // Driven backwards; only moves in the same direction are merged.
+    bool reverse = false;
 };
 
 struct Pos {
@@ -99,6 +142,10 @@ private:
     Real m_fWheelVelocity;
     CRange<CRadians> m_cGoStraightAngleRange;
     std::string m_outputDir;
+    bool m_macroActions = false;
+    bool m_batchSteps = false;
+    // Last node finished in this control step, -1 for none.
+    int m_ackNode = -1;
 
     Real pidLinear(Real error);
     std::pair<Real, Real> Move(CVector3& targetPos, CVector3& currPos, Real currAngle, Real tolerance);
@@ -109,6 +156,10 @@ private:
     Real ChangeCoordinateFromMapToArgos(Real x);
     Real ChangeCoordinateFromArgosToMap(Real x);
     void insertActions(std::vector<outputTuple> actions);
+    // Calls the init or update RPC, or its macro variant when macroActions is set.
+    std::vector<outputTuple> requestActions(const std::string& method);
+    // Reports node_id finished; with batchSteps the reply comes with the next control step.
+    std::string acknowledge(int node_id);
     double getReferenceSpeed(double dist);
     void updateQueue();
     void setWheels(Real left_v, Real right_v) {
@@ -16,6 +16,10 @@ def parse_arguments():
     parser.add_argument("--stats_name", type=str, required=False, default="stats.csv", help="Name of the statistics file for simulator")
     parser.add_argument("--port_num", type=int, required=False, default=8182, help="Port number for sim and client")
     parser.add_argument("--flip_coord", type=int, required=False, default=True, help="input format of the mapf planner, 0 if xy, 1 if yx")
+    parser.add_argument("--adg_threads", type=int, required=False, default=1, help="Number of threads used to build the ADG")
+    parser.add_argument("--rpc_workers", type=int, required=False, default=1, help="Number of threads serving the robots' RPCs")
+    parser.add_argument("--macro_actions", type=int, required=False, default=0, help="1 to receive straight runs of moves as single segments")
+    parser.add_argument("--batch_steps", type=int, required=False, default=0, help="1 to send the updates of all robots in one call per tick")
 
     return parser.parse_args()
 
@@ -103,10 +107,14 @@ if __name__ == "__main__":
     print("Creating Argos config file ...")
     robot_init_pos, scen_num_agent = ArgosConfig.read_scen(scen_file_path)
     map_data, width, height = ArgosConfig.parse_map_file(map_file_path)
+    if args.macro_actions and args.batch_steps:
+        print("Macro actions cannot be combined with batched steps. exiting ...")
+        exit(-1)
     if scen_num_agent < curr_num_agent:
         print("Number of agents exceed maximum number. exiting ...")
         exit(-1)
-    ArgosConfig.create_Argos(map_data, config_filename, width, height, robot_init_pos, curr_num_agent, port_num, not args.headless)
+    ArgosConfig.create_Argos(map_data, config_filename, width, height, robot_init_pos, curr_num_agent, port_num, not args.headless,
+                             bool(args.macro_actions), bool(args.batch_steps))
     print("Argos config file created.")
 
     sim_dt = get_sim_dt_from_argos_config(config_filename)
@@ -116,7 +124,8 @@ if __name__ == "__main__":
     server_executable_path = "build/server/ADG_server"
     server_command = [server_executable_path, "-p", path_filename, "-n", str(port_num), "-o",
                       sim_stats_filename, "-m", map_file_path, "-s", str(scen_file_path), f"--method_name=LNS2",
-                      f"--flip_coord={args.flip_coord}", f"--sim_dt={sim_dt}"]
+                      f"--flip_coord={args.flip_coord}", f"--sim_dt={sim_dt}", f"--adg_threads={args.adg_threads}",
+                      f"--rpc_workers={args.rpc_workers}"]
     print(server_command)
     client_command = ["argos3", "-c", f"./{config_filename}"]
     print(client_command)
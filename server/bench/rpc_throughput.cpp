@@ -0,0 +1,133 @@
+#include <rpc/client.h>
+#include <boost/program_options.hpp>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "parser.h"
+#include "json.hpp"
+using json = nlohmann::json;
+
+using outputTuple = std::tuple<std::string, int, double, std::string, std::pair<double, double>, std::pair<double, double>>;
+
+/*
+ * RPC throughput of a running ADG_server. Every client thread drives its share of the robots like the
+ * ARGoS controllers do, asking for new actions and confirming the first pending one in turn, only as
+ * fast as the server answers, until all robots finished. Start the server on the same path file, with
+ * the --rpc_workers to measure; bench_rpc.py runs the whole sweep.
+ */
+int main(int argc, char **argv) {
+    namespace po = boost::program_options;
+    po::options_description desc("Allowed options");
+    desc.add_options()
+            ("help", "produce help message")
+            ("path_file,p", po::value<string>(), "path file the server runs")
+            ("port_number,n", po::value<int>()->default_value(8080), "rpc port number")
+            ("flip_coord", po::value<bool>()->default_value(true), "input format of the mapf planner, 0 if xy, 1 if yx")
+            ("clients", po::value<int>()->default_value(32), "number of client threads, each with its own connection")
+            ("close_server", po::value<bool>()->default_value(true), "call closeServer once all robots finished")
+            ;
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    if (vm.count("help") or not vm.count("path_file")) {
+        cout << desc << endl;
+        return 1;
+    }
+    po::notify(vm);
+    int num_clients = vm["clients"].as<int>();
+    if (num_clients < 1) {
+        std::cerr << "clients must be at least 1, exiting ..." << std::endl;
+        exit(-1);
+    }
+
+    // The server names every robot by the cell its plan starts at.
+    std::vector<std::vector<Action>> plans;
+    double raw_cost = 0.0;
+    if (not parseEntirePlan(vm["path_file"].as<string>(), plans, raw_cost, vm["flip_coord"].as<bool>())) {
+        std::cerr << "Incorrect path, exiting ..." << std::endl;
+        exit(-1);
+    }
+    std::vector<std::string> robot_names;
+    for (const auto& plan: plans) {
+        if (plan.empty()) {
+            continue;
+        }
+        std::ostringstream oss;
+        oss << static_cast<int>(plan.front().start.first) << "_" << static_cast<int>(plan.front().start.second);
+        robot_names.push_back(oss.str());
+    }
+
+    int port_number = vm["port_number"].as<int>();
+    std::atomic<long> calls {0};
+    std::atomic<long> confirmed {0};
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> clients;
+    for (int c = 0; c < num_clients; c++) {
+        clients.emplace_back([&, c]() {
+            rpc::client client("127.0.0.1", port_number);
+            std::vector<std::string> robots;
+            for (size_t i = c; i < robot_names.size(); i += num_clients) {
+                robots.push_back(robot_names[i]);
+            }
+            std::vector<std::deque<int>> pending(robots.size());
+            std::vector<bool> finished(robots.size(), false);
+            int running = static_cast<int>(robots.size());
+            long local_calls = 0;
+            auto request = [&](const std::string& method, size_t i) {
+                for (const auto& action: client.call(method, robots[i]).as<std::vector<outputTuple>>()) {
+                    pending[i].push_back(std::get<1>(action));
+                }
+                local_calls++;
+            };
+            for (size_t i = 0; i < robots.size(); i++) {
+                request("init", i);
+            }
+            while (running > 0) {
+                for (size_t i = 0; i < robots.size(); i++) {
+                    if (finished[i]) {
+                        continue;
+                    }
+                    request("update", i);
+                    if (pending[i].empty()) {
+                        continue;
+                    }
+                    std::string msg = client.call("receive_update", robots[i], pending[i].front()).as<std::string>();
+                    pending[i].pop_front();
+                    local_calls++;
+                    confirmed++;
+                    if (msg == "end" or msg == "exit") {
+                        finished[i] = true;
+                        running--;
+                    }
+                }
+            }
+            calls += local_calls;
+        });
+    }
+    for (auto& client: clients) {
+        client.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (vm["close_server"].as<bool>()) {
+        rpc::client client("127.0.0.1", port_number);
+        auto closed = client.async_call("closeServer");
+        closed.wait_for(std::chrono::seconds(1));
+    }
+    json result = {
+        {"clients", num_clients},
+        {"robots", static_cast<int>(robot_names.size())},
+        {"calls", calls.load()},
+        {"confirmed nodes", confirmed.load()},
+        {"seconds", seconds},
+        {"calls per second", seconds > 0.0 ? static_cast<double>(calls.load()) / seconds : 0.0}
+    };
+    std::cout << result.dump() << std::endl;
+    return 0;
+}
@@ -9,97 +9,183 @@
 #include <string>
 #include <sstream>
 #include <iomanip>
+#include <climits>
+#include <memory>
+#include <tuple>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <numeric>
 
 #include "parser.h"
+#include "action_store.h"
+#include "edge_store.h"
+#include "adg_snapshot.h"
 
 typedef std::vector<std::tuple<std::string, int, double, std::string, std::pair<double, double>, std::pair<double, double>>> SIM_PLAN;
+// As SIM_PLAN, with a first and last node id per entry: a straight run of moves sent as one segment.
+typedef std::vector<std::tuple<std::string, int, int, double, std::string, std::pair<double, double>, std::pair<double, double>>> MACRO_PLAN;
 
+// Type-2 edge as seen from one endpoint, built from the EdgeStore on request.
 struct Edge {
     int from_agent_id;
     int to_agent_id;
     int from_node_id;
     int to_node_id;
     bool valid = true;
-    Edge(int from_agent, int to_agent, int from_node, int to_node): from_agent_id(from_agent), to_agent_id(to_agent),
-    from_node_id(from_node), to_node_id(to_node) {}
+    Edge(int from_agent, int to_agent, int from_node, int to_node, bool valid = true): from_agent_id(from_agent),
+    to_agent_id(to_agent), from_node_id(from_node), to_node_id(to_node), valid(valid) {}
+};
+
+struct Type2EdgeRecord {
+    int from_agent;
+    int from_node;
+    int to_agent;
+    int to_node;
+
+    // Endpoint with the smaller agent id first, matching the order of the pairwise agent scan.
+    [[nodiscard]] std::tuple<int, int, int, int> scanKey() const {
+        if (from_agent < to_agent) {
+            return {from_agent, from_node, to_agent, to_node};
+        }
+        return {to_agent, to_node, from_agent, from_node};
+    }
+};
+
+// What ADG_server does with a cyclic graph, which would deadlock the execution.
+enum class CycleCheck {
+    OFF,
+    REJECT,
+    REPAIR
+};
+
+struct ADGOptions {
+    int num_threads = 1;
+    // Drop type-2 edges implied by another type-2 edge between the same agents plus the type-1 chains.
+    bool reduce_type2_edges = false;
+    // Drop type-2 edges of turns implied by an edge of the move right before or after the turn.
+    bool prune_turn_edges = false;
+    CycleCheck cycle_check = CycleCheck::REJECT;
+    // Without type-2 edges the graph only holds the actions, for executions that order the visits of
+    // each point themselves, see visit_queues.h.
+    bool type2_edges = true;
+    // Sub-actions per grid move in the plans, see processActions; sets the coordinate resolution.
+    int move_splits = 2;
 };
 
 struct ADG_STATS {
     int type1EdgeCount = 0;
     int type2EdgeCount = 0;
+    int reducedType2EdgeCount = 0;
+    int prunedTurnEdgeCount = 0;
     int moveActionCount = 0;
     int rotateActionCount = 0;
+    int reverseMoveCount = 0;
     int consecutiveMoveSequences = 0;
     int totalNodes = 0;
-    std::set<std::pair<int, int>> conflict_pairs;
-};
-
-struct ADGNode {
-    Action action;
-    int node_id;
-    std::vector<std::shared_ptr<Edge>> incomeEdges;
-    std::vector<std::shared_ptr<Edge>> outEdges;
-    bool has_valid_in_edge = true;
+    // Sorted, deduplicated (smaller agent, larger agent) pairs sharing at least one type-2 edge.
+    std::vector<std::pair<int, int>> conflict_pairs;
+    // Memory per node of the old node layout (full Action plus edge vectors) and of the current
+    // hot (dependency counter, edge offsets) and cold (packed action) arrays, edges excluded.
+    int legacyBytesPerNode = 0;
+    int hotBytesPerNode = 0;
+    int coldBytesPerNode = 0;
 };
 
+/*
+ * The action dependency graph of a set of plans: the actions, the type-1 chains implied by the plan
+ * order and the type-2 edges between agents. It is immutable once built, so any number of
+ * ExecutionStates (see execution_state.h) can share one instance across threads.
+ */
 class ADG {
 public:
-    ADG(const std::vector<std::vector<Action>>& plans);
+    ADG(const std::vector<std::vector<Action>>& plans, const ADGOptions& options = {});
+    // Snapshot of the built graph, see adg_snapshot.h.
+    void writeSnapshot(SnapshotWriter& writer) const;
+    static std::shared_ptr<ADG> readSnapshot(SnapshotReader& reader);
     [[nodiscard]] int numRobots() const {
         return num_robots;
     }
 
+    // Nodes held by the graph; after compaction this is less than the sum of the plan sizes.
     [[nodiscard]] int numNodes() const {
         return total_nodes_cnt;
     }
 
-    std::pair<std::map<int, std::string>, std::map<std::string, int>> createRobotIDToStartIndexMaps();
-    bool getAvailableNodes(int robot_id, std::vector<int>& available_nodes);
-    bool updateFinishedNode(int robot_id, int node_id);
-    void setEnqueueNodes(int robot_id, std::vector<int>& enqueue_nodes);
-    SIM_PLAN getPlan(int agent_id);
-    bool isAgentFinished(int robot_id) {
-        return finished_node_idx[robot_id] >= graph[robot_id].size()-1;
+    [[nodiscard]] int firstNode(int robot_id) const {
+        return action_store.first_node[robot_id];
     }
 
-    void printProgress()
-    {
-        for (int agent_id = 0; agent_id < num_robots; agent_id++) {
-            std::cout << "Agent " << agent_id << ", ID: " << robotIDToStartIndex[agent_id] << " with plan size " << graph[agent_id].size() << ": ";
-            findConstraining(agent_id);
-            for (int i = 0; i <= finished_node_idx[agent_id]; i++) {
-                std::cout << "#";
-            }
-            for (auto elem: enqueue_nodes_idx[agent_id]) {
-                std::cout << '0';
-            }
-            int unstart;
-            if (enqueue_nodes_idx[agent_id].empty()) {
-                unstart = finished_node_idx[agent_id];
-            } else {
-                unstart = enqueue_nodes_idx[agent_id].back();
-            }
-            for (int i = unstart+1; i < graph[agent_id].size(); i++) {
-                std::cout << "*";
-            }
-            std::cout << std::endl;
-        }
-        std::cout << std::endl;
+    [[nodiscard]] int planSize(int robot_id) const {
+        return action_store.planSize(robot_id);
     }
 
-private:
-    void printActions(const std::vector<std::tuple<std::string, int, double, std::string, std::pair<double, double>, std::pair<double, double>>>& actions);
-    void findConstraining(int robot_id);
+    [[nodiscard]] const ActionStore& actions() const {
+        return action_store;
+    }
+
+    [[nodiscard]] const EdgeStore& edges() const {
+        return edge_store;
+    }
+
+    [[nodiscard]] const std::string& robotName(int robot_id) const {
+        return robotIDToStartIndex.at(robot_id);
+    }
+
+    std::pair<std::map<int, std::string>, std::map<std::string, int>> createRobotIDToStartIndexMaps() const {
+        return {robotIDToStartIndex, startIndexToRobotID};
+    }
+
+    /*
+     * A new graph with segments[i] appended to the plan of agent i, for feeding plans in rolling windows.
+     * Type-2 edges are only computed between new actions and the nodes of each agent from
+     * first_unfinished[i] on; existing nodes before first_unreleased[i] gain no incoming edges.
+     * This graph is left untouched, so executions over it stay valid until they rebase.
+     */
+    std::shared_ptr<ADG> extend(const std::vector<std::vector<Action>>& segments,
+                                const std::vector<int>& first_unfinished,
+                                const std::vector<int>& first_unreleased) const;
+
+    // A new graph without the nodes of agent i before first_kept[i] and the edges touching them.
+    // Node ids do not change, see ActionStore.
+    std::shared_ptr<ADG> compact(const std::vector<int>& first_kept) const;
+
+    // Strongly connected components of more than one node over the type-1 and type-2 edges, each as
+    // sorted global node indices. The graph can only be executed to the end when there are none.
+    std::vector<std::vector<int>> findCycles(int num_threads = 1) const;
+    // A new graph without the type-2 edges inside a component that join actions starting at the same
+    // time (ties_only), or else that go from a larger to a smaller agent. Sets removed to their count.
+    std::shared_ptr<ADG> breakCycles(const std::vector<std::vector<int>>& components, bool ties_only,
+                                     int& removed) const;
+    void printCycles(const std::vector<std::vector<int>>& components) const;
+
+    // Type-2 edges of a node, all marked valid; ExecutionState reports the validity of one run.
+    std::vector<Edge> getIncomeEdges(int robot_id, int node_id) const;
+    std::vector<Edge> getOutEdges(int robot_id, int node_id) const;
+    static void printActions(const SIM_PLAN& actions);
 
-public:
-    std::vector< int > finished_node_idx;
-    std::vector< std::deque<int> > enqueue_nodes_idx;
     ADG_STATS adg_stats;
 
 private:
-    std::vector<std::vector<ADGNode>> graph;
+    ADG() = default;
+    void buildRobotNames();
+    void countActions(const std::vector<Action>& actions, bool consecutive_move);
+    void addConflictPairs(const std::vector<Type2EdgeRecord>& type2_edges);
+    void buildType2Edges(int num_threads);
+    static void reduceType2Edges(std::vector<Type2EdgeRecord>& type2_edges);
+    // Returns the number of edges dropped.
+    int pruneTurnEdges(std::vector<Type2EdgeRecord>& type2_edges) const;
+    void scanCell(const CellIndex& cell_index, const CellIndex::Cell& cell,
+                  std::vector<Type2EdgeRecord>& type2_edges) const;
+
+    ADGOptions options;
+    // Cold per-node data, only read when building the graph or serializing a plan.
+    ActionStore action_store;
+    // Hot per-node data: the edge offsets of the type-2 edges over global node indices.
+    EdgeStore edge_store;
     int num_robots = 0;
     int total_nodes_cnt = 0;
+    // Robots are named after their start cell, "x_y", which is how the clients identify themselves.
     std::map<int, std::string> robotIDToStartIndex;
     std::map<std::string, int> startIndexToRobotID;
 };
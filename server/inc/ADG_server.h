@@ -2,11 +2,16 @@
 #include <string>
 #include <iostream>
 #include "ADG.h"
+#include "execution_state.h"
+#include "plan_window.h"
+#include "visit_queues.h"
 #include <iostream>
 #include <vector>
 #include <tuple>
 #include <stdexcept>
 #include <mutex>
+#include <shared_mutex>
+#include <atomic>
 #include <sstream>
 #include <functional>
 #include <boost/program_options.hpp>
@@ -14,38 +19,113 @@
 #include <fstream>
 #include <map>
 #include <numeric>
+#include <chrono>
 #include "json.hpp"
 using json = nlohmann::json;
 
-#include <mutex>
+// Replies of the step RPC: receive_update replies by robot name, and the released actions of all robots.
+typedef std::pair<std::map<std::string, std::string>, SIM_PLAN> STEP_RESULT;
 
-std::mutex globalMutex;
+// Locks held by an RPC of one robot, see ADG_Server::lockRobot.
+struct RobotLock {
+    std::shared_lock<std::shared_mutex> shared;
+    std::unique_lock<std::shared_mutex> exclusive;
+    std::unique_lock<std::mutex> robot;
+};
 
 class ADG_Server{
 public:
     ADG_Server(std::string& path_filename, std::string& target_output_filename,
-        std::string map_name, std::string scen_name, std::string method_name, bool flip_coord, double sim_dt_seconds);
+        std::string map_name, std::string scen_name, std::string method_name, bool flip_coord, double sim_dt_seconds,
+        const ADGOptions& adg_options = {}, const std::string& adg_cache_dir = "", double adg_window = 0.0,
+        int compact_interval = 0, bool switch_edges = false, const DurationModel& durations = {},
+        bool critical_priority = false, bool eta = false, bool reverse_moves = false, double platoon_gap = 0.0,
+        int rpc_workers = 1);
     void saveStats();
+    // Appends a path segment per named robot to the running ADG; returns the number of new nodes or -1.
+    int extendPlans(const std::map<std::string, std::string>& segments);
+    // Materializes more of the plans when running with a window; call after nodes finish.
+    void advanceWindow();
+    // Drops finished nodes once compact_interval of them piled up; call after nodes finish.
+    void compactIfDue();
+    bool isAgentFinished(int robot_id) const;
+    // Estimated finish time of robot_id in seconds since the server started, -1 without ETA tracking.
+    double estimatedFinishTime(int robot_id) const;
+    // Executes through whichever engine the server runs.
+    SIM_PLAN getPlan(int robot_id);
+    // getPlan with every straight run of moves that nobody waits on in between sent as one segment.
+    MACRO_PLAN getMacroPlan(int robot_id);
+    bool updateFinishedNode(int robot_id, int node_id);
+
+    /*
+     * With several RPC workers, calls of different robots run in parallel when the execution shares
+     * nothing but edge validity and dependency counters between robots: each holds the server lock
+     * shared and the lock of its robot. Otherwise, and always in lockAll, a call holds the server
+     * lock exclusively.
+     */
+    RobotLock lockRobot(int robot_id);
+    std::unique_lock<std::shared_mutex> lockAll() {
+        return std::unique_lock<std::shared_mutex>(server_mutex);
+    }
+    [[nodiscard]] bool concurrent() const {
+        return concurrent_;
+    }
     
-    std::shared_ptr<ADG> adg;
+    std::shared_ptr<const ADG> adg;
+    // Exactly one of the two engines is set: visit queues when the ADG has no type-2 edges.
+    std::shared_ptr<ExecutionState> execution;
+    std::unique_ptr<VisitQueueState> visit_queues;
+    // Set when the ADG is materialized lazily, holds the actions beyond its horizon.
+    std::unique_ptr<PlanWindow> plan_window;
     std::map<int, std::string> robotIDTOStartIndex;
     std::map<std::string, int> startIndexToRobotID;
+    // Plans the ADG is first built from; later extensions only live in the ADG.
     std::vector<std::vector<Action>> plans;
     std::vector<std::vector<int>> outgoingEdgesByRobot;
     std::vector<double> agent_finish_time;
     std::vector<int> agent_finish_sim_step;
-    int latest_arr_sim_step = 0;
-    bool all_agents_finished = false;
-    std::vector<bool> agents_finish;
+    std::atomic<int> latest_arr_sim_step {0};
+    std::atomic<bool> all_agents_finished {false};
+    // Written by the robots in parallel, so one byte each.
+    std::vector<char> agents_finish;
+    std::atomic<int> finished_agents {0};
     std::string output_filename;
     std::string curr_map_name;
     std::string curr_scen_name;
     std::string curr_method_name;
     int numRobots = 0;
-    int step_cnt = 0;
+    std::atomic<int> step_cnt {0};
 
 private:
+    static constexpr uint64_t SNAPSHOT_MAGIC = 0x3147444154524d53ULL; // "SMRTADG1"
+    static constexpr uint32_t SNAPSHOT_VERSION = 7;
+
+    uint64_t snapshotKey(bool flip_coord, const ADGOptions& adg_options) const;
+    bool loadSnapshot(const std::string& filename, uint64_t key);
+    void saveSnapshot(const std::string& filename, uint64_t key) const;
+
     std::string path_filename_;
+    bool flip_coord_ = true;
+    int move_splits_ = 2;
+    bool reverse_moves_ = false;
+    void trackGraphSize();
+    void checkCycles(const ADGOptions& adg_options);
+
     double raw_plan_cost = -1.0;
+    int compact_interval_ = 0;
+    int compaction_count = 0;
+    int cycle_edges_removed = 0;
+    int peak_graph_nodes = 0;
+    int peak_graph_edges = 0;
+    // Critical path of the whole plan as built, before any node finished.
+    double estimated_makespan = 0.0;
+    std::chrono::steady_clock::time_point run_start = std::chrono::steady_clock::now();
+    std::vector<int> critical_agents;
+    // Segments sent by getMacroPlan and the nodes they cover.
+    std::atomic<int> macro_segments {0};
+    std::atomic<int> macro_nodes {0};
     double sim_dt_seconds_ = 0.1;
+    bool concurrent_ = false;
+    std::shared_mutex server_mutex;
+    std::vector<std::mutex> robot_mutexes;
 };
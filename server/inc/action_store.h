@@ -0,0 +1,139 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <utility>
+
+#include "parser.h"
+#include "adg_snapshot.h"
+
+// Plan actions of all agents in structure-of-arrays form. Action j of agent i lives at index
+// node_offset[i] + j - first_node[i], where first_node[i] counts the actions dropped from the front
+// of the plan, so node ids stay stable. Coordinates are int16 fixed point with cell_units per cell,
+// two by default, so the end points of split moves are exact. The orientation takes the two low bits
+// of flags, the next one marks reverse moves. This is the cold per-node data of the ADG.
+struct ActionStore {
+    std::vector<int> node_offset;
+    std::vector<int> first_node;
+    std::vector<int32_t> agent_id;
+    std::vector<int16_t> start_x;
+    std::vector<int16_t> start_y;
+    std::vector<int16_t> goal_x;
+    std::vector<int16_t> goal_y;
+    std::vector<double> time;
+    std::vector<char> type;
+    std::vector<uint8_t> flags;
+    int cell_units = 2;
+
+    static constexpr uint8_t ORIENTATION_MASK = 0x3;
+    static constexpr uint8_t REVERSE_FLAG = 0x4;
+    static constexpr size_t BYTES_PER_ACTION = sizeof(int32_t) + 4 * sizeof(int16_t) + sizeof(double) +
+                                               sizeof(char) + sizeof(uint8_t);
+
+    void build(const std::vector<std::vector<Action>>& plans, int units = 2);
+    // Appends segments[i] to the actions of agent i; existing actions keep their per-agent node ids.
+    void append(const std::vector<std::vector<Action>>& segments);
+    // Drops the actions of agent i before node first_kept[i].
+    void dropBefore(const std::vector<int>& first_kept);
+    // Stores action at index idx, whose arrays must already be sized.
+    void set(int idx, int agent, const Action& action);
+    // Inverse of build; the parser numbers nodes globally, so nodeID is the action index.
+    [[nodiscard]] std::vector<std::vector<Action>> toPlans() const;
+    // The action at index idx, with the index as its nodeID.
+    [[nodiscard]] Action action(int idx) const;
+    void writeSnapshot(SnapshotWriter& writer) const;
+    bool readSnapshot(SnapshotReader& reader);
+
+    [[nodiscard]] int size() const {
+        return static_cast<int>(agent_id.size());
+    }
+
+    // Node ids of agent i run from first_node[i] to planSize(i) - 1.
+    [[nodiscard]] int planSize(int agent) const {
+        return first_node[agent] + node_offset[agent+1] - node_offset[agent];
+    }
+
+    [[nodiscard]] int orientation(int idx) const {
+        return flags[idx] & ORIENTATION_MASK;
+    }
+
+    [[nodiscard]] bool isReverse(int idx) const {
+        return (flags[idx] & REVERSE_FLAG) != 0;
+    }
+
+    // Action type as sent to the robots, which drive reverse moves ('R') backwards.
+    [[nodiscard]] char robotType(int idx) const {
+        return isReverse(idx) ? 'R' : type[idx];
+    }
+
+    [[nodiscard]] std::pair<double, double> startPoint(int idx) const {
+        return {start_x[idx] / static_cast<double>(cell_units), start_y[idx] / static_cast<double>(cell_units)};
+    }
+
+    [[nodiscard]] std::pair<double, double> goalPoint(int idx) const {
+        return {goal_x[idx] / static_cast<double>(cell_units), goal_y[idx] / static_cast<double>(cell_units)};
+    }
+
+    [[nodiscard]] int index(int agent, int node) const {
+        return node_offset[agent] + node - first_node[agent];
+    }
+
+    [[nodiscard]] int nodeOf(int idx) const {
+        int agent = agent_id[idx];
+        return idx - node_offset[agent] + first_node[agent];
+    }
+
+    [[nodiscard]] uint64_t startCell(int idx) const {
+        return packCell(start_x[idx], start_y[idx]);
+    }
+
+    [[nodiscard]] uint64_t goalCell(int idx) const {
+        return packCell(goal_x[idx], goal_y[idx]);
+    }
+
+    [[nodiscard]] int16_t toUnits(double coord) const;
+    // Whether both coordinates of the action's start and goal fit toUnits.
+    [[nodiscard]] bool fits(const Action& action) const;
+
+    static uint64_t packCell(int32_t x, int32_t y) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y);
+    }
+};
+
+// Actions grouped by the cell they leave and the cell they enter, each group sorted by time.
+// The fields of the entering actions compared by the type-2 scan are gathered in entering order.
+struct CellIndex {
+    struct Cell {
+        uint64_t code;
+        int leave_begin, leave_end;
+        int enter_begin, enter_end;
+    };
+
+    std::vector<int> leaving;
+    std::vector<int> entering;
+    std::vector<int32_t> enter_agent;
+    std::vector<int32_t> enter_start_x;
+    std::vector<int32_t> enter_start_y;
+    std::vector<double> enter_time;
+    // Only cells that are both left and entered can produce type-2 edges.
+    std::vector<Cell> cells;
+
+    void build(const ActionStore& actions);
+    // Index over the given action indices only.
+    void build(const ActionStore& actions, std::vector<int> subset);
+};
+
+/*
+ * Writes to out the positions p in [begin, end) of the entering arrays that receive a type-2 edge
+ * from a leaving action of leave_agent with goal (goal_x, goal_y), and returns how many were written.
+ * Positions before tie_end start at the same time as the leaving action; for those an action of a
+ * smaller agent that swaps cells with the leaving one keeps the edge in its own direction instead.
+ * Uses AVX2 or SSE2 compares when the compiler targets them, with a scalar fallback.
+ */
+int matchEnteringActions(const int32_t* agent, const int32_t* start_x, const int32_t* start_y,
+                         int begin, int tie_end, int end,
+                         int32_t leave_agent, int32_t goal_x, int32_t goal_y, int* out);
+int matchEnteringActionsScalar(const int32_t* agent, const int32_t* start_x, const int32_t* start_y,
+                               int begin, int tie_end, int end,
+                               int32_t leave_agent, int32_t goal_x, int32_t goal_y, int* out);
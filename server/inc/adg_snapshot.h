@@ -0,0 +1,97 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
+// Binary writer for ADG snapshots: trivially copyable values and length-prefixed arrays.
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(const std::string& filename): out(filename, std::ios::binary | std::ios::trunc) {}
+
+    [[nodiscard]] bool good() const {
+        return out.good();
+    }
+
+    template <typename T>
+    void value(const T& v) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        out.write(reinterpret_cast<const char*>(&v), sizeof(T));
+    }
+
+    template <typename T>
+    void array(const std::vector<T>& v) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        value<uint64_t>(v.size());
+        out.write(reinterpret_cast<const char*>(v.data()), static_cast<std::streamsize>(sizeof(T) * v.size()));
+    }
+
+private:
+    std::ofstream out;
+};
+
+// Reader over a mapped snapshot; every read is bounds checked and returns false past the end.
+class SnapshotReader {
+public:
+    SnapshotReader(const char* data, size_t size): data(data), size(size) {}
+
+    template <typename T>
+    bool value(T& v) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        if (size - pos < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&v, data + pos, sizeof(T));
+        pos += sizeof(T);
+        return true;
+    }
+
+    template <typename T>
+    bool array(std::vector<T>& v) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        uint64_t len = 0;
+        if (not value(len) or len > (size - pos) / sizeof(T)) {
+            return false;
+        }
+        v.resize(len);
+        std::memcpy(v.data(), data + pos, sizeof(T) * len);
+        pos += sizeof(T) * len;
+        return true;
+    }
+
+private:
+    const char* data;
+    size_t size;
+    size_t pos = 0;
+};
+
+// Read-only mmap of a whole file.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& filename);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    [[nodiscard]] bool valid() const {
+        return data_ != nullptr;
+    }
+
+    [[nodiscard]] const char* data() const {
+        return data_;
+    }
+
+    [[nodiscard]] size_t size() const {
+        return size_;
+    }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// 64-bit FNV-1a, used to key snapshots by the content of the path file.
+uint64_t fnv1aHash(const char* data, size_t size, uint64_t hash = 14695981039346656037ULL);
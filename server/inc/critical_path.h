@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <limits>
+#include <cstddef>
+
+#include "action_store.h"
+
+class ExecutionState;
+
+// Estimated execution time of an action: move per cell travelled, quarter_turn per 90 degrees turned.
+struct DurationModel {
+    double move = 1.0;
+    double quarter_turn = 1.0;
+
+    [[nodiscard]] double duration(const ActionStore& actions, int idx) const;
+};
+
+/*
+ * Longest path through the unfinished nodes of an execution, weighted by estimated action durations,
+ * and the slack of every node: how much it may be delayed without delaying that path. Nodes finishing
+ * only make the analysis stale; it is recomputed on the next query once refresh_interval nodes
+ * finished since the last pass or the graph changed, so queries stay cheap between refreshes.
+ */
+class CriticalPath {
+public:
+    CriticalPath(const DurationModel& model, int refresh_interval): model(model),
+        refresh_interval(refresh_interval) {}
+
+    void nodesFinished(int count) {
+        finished_since_update.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    void graphChanged() {
+        graph_changed = true;
+    }
+
+    // Slack of node index idx; infinite for finished nodes.
+    double slack(const ExecutionState& execution, int idx);
+    // Estimated time until the last agent finishes.
+    double length(const ExecutionState& execution);
+    // Agents with an unfinished node on the longest path.
+    std::vector<int> criticalAgents(const ExecutionState& execution);
+
+    [[nodiscard]] size_t memoryBytes() const {
+        return sizeof(*this) + (earliest_start.capacity() + slack_time.capacity()) * sizeof(double);
+    }
+
+private:
+    static constexpr double INF = std::numeric_limits<double>::infinity();
+
+    void refresh(const ExecutionState& execution);
+    void update(const ExecutionState& execution);
+
+    DurationModel model;
+    int refresh_interval;
+    // Counted by agents finishing nodes in parallel, see ExecutionState.
+    std::atomic<int> finished_since_update {0};
+    bool graph_changed = true;
+    double path_length = 0.0;
+    std::vector<double> earliest_start;
+    std::vector<double> slack_time;
+};
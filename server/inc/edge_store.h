@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+
+#include "adg_snapshot.h"
+
+/*
+ * Type-2 edges over global node indices in compressed sparse row (outgoing) and compressed sparse
+ * column (incoming) form. Edge ids follow the CSR order, so the outgoing edges of node v are the ids
+ * [outBegin(v), outEnd(v)). Incoming edges are listed through in_edge, sorted by source node.
+ * The store is immutable after build; per-run edge validity lives in ExecutionState.
+ */
+class EdgeStore {
+public:
+    // edges holds (from, to) node pairs; edges leaving the same node keep their relative order.
+    void build(int num_nodes, const std::vector<std::pair<int, int>>& edges);
+    void writeSnapshot(SnapshotWriter& writer) const;
+    bool readSnapshot(SnapshotReader& reader, int num_nodes);
+
+    [[nodiscard]] int numEdges() const {
+        return static_cast<int>(out_target.size());
+    }
+
+    [[nodiscard]] int outBegin(int node) const {
+        return out_offset[node];
+    }
+
+    [[nodiscard]] int outEnd(int node) const {
+        return out_offset[node+1];
+    }
+
+    [[nodiscard]] int target(int edge) const {
+        return out_target[edge];
+    }
+
+    [[nodiscard]] int inBegin(int node) const {
+        return in_offset[node];
+    }
+
+    [[nodiscard]] int inEnd(int node) const {
+        return in_offset[node+1];
+    }
+
+    // Edge id and source node of the k-th incoming slot.
+    [[nodiscard]] int inEdge(int k) const {
+        return in_edge[k];
+    }
+
+    [[nodiscard]] int inSource(int k) const {
+        return in_source[k];
+    }
+
+    // Bytes of the offset arrays, the part of the store paid per node rather than per edge.
+    [[nodiscard]] size_t nodeBytes() const {
+        return (out_offset.capacity() + in_offset.capacity()) * sizeof(int);
+    }
+
+private:
+    std::vector<int> out_offset;
+    std::vector<int> out_target;
+    std::vector<int> in_offset;
+    std::vector<int> in_edge;
+    std::vector<int> in_source;
+};
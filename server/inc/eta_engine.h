@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <utility>
+#include <functional>
+
+#include "critical_path.h"
+
+class ExecutionState;
+
+/*
+ * Estimated finish time of every node. Finished nodes keep the time they were reported at; any other
+ * node starts once its agent reported its last node and everything it waits on is estimated to
+ * finish. A report only revisits the downstream nodes whose estimate changes, nearest first, as a
+ * dynamic longest path update, and the estimates of the last nodes answer ETA queries directly.
+ */
+class EtaEngine {
+public:
+    explicit EtaEngine(const DurationModel& model): model(model) {}
+
+    // Back to no reports at all, every node estimated from scratch.
+    void reset(const ExecutionState& execution);
+    // Carries estimates over to next by node id; call before the execution moves to the next graph.
+    void remap(const ActionStore& old_actions, const ActionStore& next_actions);
+    // Estimates every unfinished node from scratch, keeping the reported times.
+    void recompute(const ExecutionState& execution);
+    // Records node index idx as finished at now; call before its edges are invalidated.
+    void nodeFinished(const ExecutionState& execution, int idx, double now);
+    // Queues node index idx for a new estimate, after its dependencies changed.
+    void touch(int idx) {
+        enqueue(0.0, idx);
+    }
+    // Updates the queued nodes and whatever their new estimates affect.
+    void propagate(const ExecutionState& execution);
+
+    [[nodiscard]] double eta(int robot_id) const {
+        return agent_eta[robot_id];
+    }
+
+    [[nodiscard]] double finishEstimate(int idx) const {
+        return finish_time[idx];
+    }
+
+    // Estimates changed by reports so far, a measure of how far delays spread.
+    [[nodiscard]] long updatedEstimates() const {
+        return updated_estimates;
+    }
+
+    [[nodiscard]] size_t memoryBytes() const {
+        return sizeof(*this) + finish_time.capacity() * sizeof(double) + queued.capacity() +
+               (agent_eta.capacity() + last_report.capacity()) * sizeof(double);
+    }
+
+private:
+    double estimate(const ExecutionState& execution, int idx) const;
+    void setFinishTime(const ExecutionState& execution, int idx, double time);
+
+    // A node waits in pending at most once, under the first key it was queued with.
+    void enqueue(double key, int idx) {
+        if (not queued[idx]) {
+            queued[idx] = 1;
+            pending.emplace(key, idx);
+        }
+    }
+
+    DurationModel model;
+    std::vector<double> finish_time;
+    // Per agent, the estimate of its last node and the time it last reported a finished node.
+    std::vector<double> agent_eta;
+    std::vector<double> last_report;
+    long updated_estimates = 0;
+    std::priority_queue<std::pair<double, int>, std::vector<std::pair<double, int>>, std::greater<>> pending;
+    std::vector<char> queued;
+};
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+#include <unordered_map>
+#include <functional>
+
+#include "ADG.h"
+#include "critical_path.h"
+#include "eta_engine.h"
+
+// A type-2 order reversed at runtime: first_agent now passes point before second_agent does.
+struct SwitchedOrder {
+    std::pair<double, double> point;
+    int first_agent;
+    int first_node;
+    int second_agent;
+    int second_node;
+};
+
+/*
+ * Progress of one execution over a shared, read-only ADG: which nodes each agent finished or has
+ * enqueued, which type-2 edges are still valid and how many valid edges still block each node.
+ * Only this state is written while executing, so several runs of the same plan can each own an
+ * ExecutionState over one ADG, in threads or forked processes, without copying the graph.
+ * Edge validity and dependency counters are atomic: without switching, updates and plan requests of
+ * different agents only share those and may run in parallel. Platoon following only drops edges out
+ * of the releasing agent's own nodes. ETA estimates span all agents, so with them every report, and
+ * every release that drops platoon edges, holds the ETA lock.
+ */
+class ExecutionState {
+public:
+    explicit ExecutionState(std::shared_ptr<const ADG> adg);
+
+    [[nodiscard]] const ADG& graph() const {
+        return *adg;
+    }
+
+    [[nodiscard]] const std::shared_ptr<const ADG>& sharedGraph() const {
+        return adg;
+    }
+
+    // Back to the state before the first action, keeping the graph.
+    void reset();
+    // Per agent, the first node not finished yet and the first node not released yet, see ADG::extend.
+    void extensionBounds(std::vector<int>& first_unfinished, std::vector<int>& first_unreleased) const;
+    // Continues this execution on next, a graph returned by extend or compact on the current one.
+    void rebase(std::shared_ptr<const ADG> next);
+    // Finished nodes that compact would drop: all but the last node of each agent.
+    [[nodiscard]] int deadNodes() const;
+    // Moves to a graph without the dead nodes; their edges are all invalid by then. False if none.
+    bool compact();
+
+    std::vector<Edge> getIncomeEdges(int robot_id, int node_id) const;
+    std::vector<Edge> getOutEdges(int robot_id, int node_id) const;
+    bool getAvailableNodes(int robot_id, std::vector<int>& available_nodes);
+    bool updateFinishedNode(int robot_id, int node_id);
+    void setEnqueueNodes(int robot_id, std::vector<int>& enqueue_nodes);
+    SIM_PLAN getPlan(int agent_id);
+    bool isAgentFinished(int robot_id) const {
+        return finished_node_idx[robot_id] >= adg->planSize(robot_id)-1;
+    }
+
+    // Whether another agent still waits for node index idx to finish.
+    [[nodiscard]] bool hasWaiters(int idx) const;
+
+    [[nodiscard]] bool isEdgeValid(int edge) const {
+        return (valid_bits[edge >> 6].load(std::memory_order_relaxed) >> (edge & 63)) & 1u;
+    }
+
+    /*
+     * With switching on, an agent blocked at the point entered by its next node may overtake the agent
+     * its type-2 edge waits for, when that agent has not been released into the point yet. The edge
+     * X -> Y is then replaced by one from the node where the waiting agent leaves the point to the node
+     * where the other one enters it, unless that closes a cycle.
+     */
+    void enableSwitching(bool enable) {
+        switch_edges = enable;
+    }
+
+    [[nodiscard]] const std::vector<SwitchedOrder>& switchedOrders() const {
+        return switched_orders;
+    }
+
+    /*
+     * Platoon following: an edge X -> Y between two moves in the same direction, so agent b follows
+     * agent a through the point X leaves, is dropped as soon as a is released into a point gap cells
+     * past it, instead of waiting for X to be confirmed. A gap up to one sub-action releases Y together
+     * with X. This only ever releases Y earlier, so it cannot deadlock.
+     */
+    void enablePlatoon(double gap) {
+        platoon_gap = gap;
+    }
+
+    // Edges dropped by platoon following so far.
+    [[nodiscard]] long platoonReleases() const {
+        return platoon_releases.load();
+    }
+
+    /*
+     * Tracks the critical path of the remaining execution. With prioritize, switching keeps an order
+     * when the agent it lets go first has less slack than the one it would hold back.
+     */
+    void enableCriticalPath(const DurationModel& model, bool prioritize);
+
+    // Null unless enabled.
+    [[nodiscard]] CriticalPath* criticalPath() const {
+        return critical_path.get();
+    }
+
+    // Keeps finish time estimates of every node, see eta_engine.h; clock gives the current time.
+    void enableEta(const DurationModel& model, std::function<double()> clock);
+
+    // Null unless enabled.
+    [[nodiscard]] const EtaEngine* etaEngine() const {
+        return eta_engine.get();
+    }
+
+    // EtaEngine::eta under the ETA lock; ETAs must be enabled.
+    [[nodiscard]] double eta(int robot_id) const {
+        std::lock_guard<std::mutex> guard(eta_mutex);
+        return eta_engine->eta(robot_id);
+    }
+
+    [[nodiscard]] bool isFinished(int idx) const {
+        const ActionStore& actions = adg->actions();
+        return actions.nodeOf(idx) <= finished_node_idx[actions.agent_id[idx]];
+    }
+
+    // Remaining dependencies of node index idx, type-1 predecessor excluded.
+    [[nodiscard]] int remainingDeps(int idx) const {
+        return remaining_deps[idx];
+    }
+
+    // Calls visit(u) for every resident node index u that node index idx waits or waited on: the previous
+    // node of its agent, the sources of its type-2 edges unless switched away, and its switched sources.
+    template <typename Visit>
+    void forEachPredecessor(int idx, Visit visit) const {
+        const ActionStore& actions = adg->actions();
+        const EdgeStore& edges = adg->edges();
+        int agent = actions.agent_id[idx];
+        if (idx > actions.node_offset[agent]) {
+            visit(idx - 1);
+        }
+        for (int k = edges.inBegin(idx); k < edges.inEnd(idx); k++) {
+            int source = edges.inSource(k);
+            if (isEdgeValid(edges.inEdge(k)) or isFinished(source)) {
+                visit(source);
+            }
+        }
+        if (not dynamic_in.empty()) {
+            auto dynamic = dynamic_in.find(nodeKey(agent, actions.nodeOf(idx)));
+            if (dynamic != dynamic_in.end()) {
+                for (const auto& [source_agent, node]: dynamic->second) {
+                    if (node >= actions.first_node[source_agent]) {
+                        visit(actions.index(source_agent, node));
+                    }
+                }
+            }
+        }
+    }
+
+    // Calls visit(w) for every node index w waiting on node index idx: the next node of its agent, then
+    // the targets of its valid type-2 edges except skipped_edge, then those of its switched edges.
+    template <typename Visit>
+    void forEachSuccessor(int idx, Visit visit, int skipped_edge = -1) const {
+        const ActionStore& actions = adg->actions();
+        const EdgeStore& edges = adg->edges();
+        int agent = actions.agent_id[idx];
+        if (idx + 1 < actions.node_offset[agent+1]) {
+            visit(idx + 1);
+        }
+        for (int e = edges.outBegin(idx); e < edges.outEnd(idx); e++) {
+            if (e != skipped_edge and isEdgeValid(e)) {
+                visit(edges.target(e));
+            }
+        }
+        if (not dynamic_out.empty()) {
+            auto dynamic = dynamic_out.find(nodeKey(agent, actions.nodeOf(idx)));
+            if (dynamic != dynamic_out.end()) {
+                for (const auto& [target_agent, node]: dynamic->second) {
+                    visit(actions.index(target_agent, node));
+                }
+            }
+        }
+    }
+
+    // Bytes owned by this state, the ADG itself excluded.
+    [[nodiscard]] size_t memoryBytes() const;
+    void printProgress();
+
+    std::vector< int > finished_node_idx;
+    std::vector< std::deque<int> > enqueue_nodes_idx;
+
+private:
+    void findConstraining(int robot_id);
+    int advanceReadyFrontier(int robot_id);
+    int firstUnreleased(int robot_id) const;
+    // Tries to switch every valid type-2 edge into blocked; true once it no longer waits.
+    bool switchBlockingEdges(int blocked);
+    bool switchEdge(int in_slot, int blocked);
+    bool reaches(int from, int to, int skipped_edge) const;
+    void releaseFollowers(int released);
+    void addDynamicDeps();
+
+    static int64_t nodeKey(int agent, int node) {
+        return (static_cast<int64_t>(agent) << 32) | static_cast<uint32_t>(node);
+    }
+
+    void invalidateEdge(int edge) {
+        valid_bits[edge >> 6].fetch_and(~(uint64_t(1) << (edge & 63)), std::memory_order_relaxed);
+    }
+
+    std::shared_ptr<const ADG> adg;
+    // One validity bit per type-2 edge id of the ADG's EdgeStore.
+    std::vector<std::atomic<uint64_t>> valid_bits;
+    // Valid incoming type-2 edges per global node index, decremented as their sources finish.
+    std::vector<std::atomic<int>> remaining_deps;
+    // Per agent, the first node that may still wait on a type-2 edge; all earlier nodes are ready.
+    std::vector<int> ready_frontier;
+    bool switch_edges = false;
+    // Per agent, the last frontier node switching was tried for.
+    std::vector<int> switch_tried;
+    // Edges added by switching, from the (agent, node) key of the source to the targets. They are kept
+    // by node id rather than node index, so they survive rebase, and dropped once the source finishes.
+    std::unordered_map<int64_t, std::vector<std::pair<int, int>>> dynamic_out;
+    // The same edges from the target side, dropped once the target finishes.
+    std::unordered_map<int64_t, std::vector<std::pair<int, int>>> dynamic_in;
+    std::vector<SwitchedOrder> switched_orders;
+    // In cells, 0 when platoon following is off.
+    double platoon_gap = 0.0;
+    std::atomic<long> platoon_releases {0};
+    std::unique_ptr<CriticalPath> critical_path;
+    bool prioritize_critical = false;
+    std::unique_ptr<EtaEngine> eta_engine;
+    std::function<double()> eta_clock;
+    // Held by whatever updates the ETA estimates while agents run in parallel.
+    mutable std::mutex eta_mutex;
+};
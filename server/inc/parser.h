@@ -18,6 +18,8 @@ struct Point {
 struct Step {
     int x, y, orientation;
     double time;
+    // Reached by driving backwards, against orientation.
+    bool reverse = false;
 };
 
 struct Action {
@@ -28,6 +30,7 @@ struct Action {
     std::pair<double, double> start;
     std::pair<double, double> goal;
     int nodeID;
+    bool reverse = false;
 };
 
 enum PlanType {
@@ -38,7 +41,17 @@ enum PlanType {
 int getOrientation(int x1, int y1, int x2, int y2);
 void processAgentActions(const vector<Point>& points, vector<Step>& steps, int agentId);
 vector<Point> parseLine(const string& line);
-std::vector<std::vector<Action>> processActions(const std::vector<std::vector<Step>>& raw_steps, bool flipped_coord);
+// Turns and moves between consecutive steps; every move is split into move_splits equal sub-actions
+// and consecutive turns in place become one.
+std::vector<std::vector<Action>> processActions(const std::vector<std::vector<Step>>& raw_steps, bool flipped_coord,
+                                                int move_splits = 2);
+// With reverse_moves, a robot backs out of a cell instead of turning around first.
 bool parseEntirePlan(const std::string& input_file, std::vector<std::vector<Action>>& plans,
-                     double& raw_cost, bool flipped_coord = true, PlanType file_type = PlanType::CONTINUOUS);
+                     double& raw_cost, bool flipped_coord = true, PlanType file_type = PlanType::CONTINUOUS,
+                     int move_splits = 2, bool reverse_moves = false);
+// Actions of robot_id for a path line in the continuous path file format, continuing a plan that ends
+// at the first point of the line with heading start_orientation. False if the line is malformed, jumps
+// or goes back in time.
+bool parseSegment(const std::string& line, int robot_id, int start_orientation, bool flipped_coord,
+                  std::vector<Action>& actions, int move_splits = 2, bool reverse_moves = false);
 void raiseError(const string &msg);
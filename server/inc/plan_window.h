@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <limits>
+
+#include "parser.h"
+#include "action_store.h"
+#include "execution_state.h"
+
+/*
+ * Lazy materialization of long plans: only actions starting before horizon() are nodes of the ADG,
+ * the rest waits here per agent. Every type-2 edge into an action before the horizon comes from an
+ * action before it as well, so the materialized graph is closed under dependencies and executes
+ * exactly like the full one. Once the slowest unfinished agent gets within half a window of the
+ * horizon, the horizon moves to one window ahead of it and the actions in between join the graph.
+ * Pending actions are kept in the same compact form as the graph's, ActionStore::BYTES_PER_ACTION each,
+ * so memory still grows with the plan length, only several times slower than the parsed plan.
+ */
+class PlanWindow {
+public:
+    // Moves every action starting at or after the first window out of plans, stored with cell_units
+    // units per cell like the graph's actions.
+    PlanWindow(double window, std::vector<std::vector<Action>>& plans, int cell_units);
+
+    [[nodiscard]] double horizon() const {
+        return horizon_time;
+    }
+
+    [[nodiscard]] bool hasPending(int robot_id) const {
+        return next_pending[robot_id] < pending.planSize(robot_id);
+    }
+
+    [[nodiscard]] Action lastPending(int robot_id) const {
+        return pending.action(pending.index(robot_id, pending.planSize(robot_id) - 1));
+    }
+
+    [[nodiscard]] long pendingCount() const {
+        return pending_count;
+    }
+
+    // Queues segments[i] after the pending actions of agent i; they join the graph on the next advance.
+    void append(const std::vector<std::vector<Action>>& segments);
+    // Slides the window if needed and rebases execution on the extended graph; true if it changed.
+    bool advance(ExecutionState& execution);
+
+private:
+    double slowestAgentTime(const ExecutionState& execution) const;
+
+    double window;
+    double horizon_time = -std::numeric_limits<double>::infinity();
+    bool appended = false;
+    long pending_count = 0;
+    // Node next_pending[i] of agent i is the first one not handed to the graph yet. The ones before it
+    // are dropped together once they outnumber the pending ones.
+    ActionStore pending;
+    std::vector<int> next_pending;
+    long handed_over = 0;
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+
+#include "ADG.h"
+
+/*
+ * Execution that derives the type-2 order from the actions instead of stored edges. Per point, the
+ * actions leaving it are queued by time, with a cursor past the finished prefix. An action entering
+ * the point may start once every action of another agent queued no later than itself has finished,
+ * which is the type-2 rule of ADG, swap ties included, so the releases match those of an
+ * ExecutionState over the full graph. Memory is a few ints per action and per point.
+ */
+class VisitQueueState {
+public:
+    // adg may be built without type-2 edges, only its actions are used.
+    explicit VisitQueueState(std::shared_ptr<const ADG> adg);
+
+    bool updateFinishedNode(int robot_id, int node_id);
+    SIM_PLAN getPlan(int agent_id);
+    bool isAgentFinished(int robot_id) const {
+        return finished_node_idx[robot_id] >= adg->planSize(robot_id)-1;
+    }
+
+    // Whether node index idx leaves a point another agent enters, so that agent may wait for it.
+    [[nodiscard]] bool hasWaiters(int idx) const {
+        return shared_leave[idx] != 0;
+    }
+
+    // Bytes owned by this state, the ADG itself excluded.
+    [[nodiscard]] size_t memoryBytes() const;
+
+private:
+    bool isFinished(int idx) const;
+    bool isReady(int idx);
+    int advanceReadyFrontier(int robot_id);
+
+    std::shared_ptr<const ADG> adg;
+    // Leaving actions grouped by point, each group sorted by time; point p owns point_begin[p] up to
+    // point_end[p]. Only points that are also entered get a group.
+    std::vector<int> leaving;
+    std::vector<int> point_begin;
+    std::vector<int> point_end;
+    // Per point, the first leaving action that may still be unfinished.
+    std::vector<int> cursor;
+    // Per action index, the point it enters, -1 if no action leaves that point.
+    std::vector<int> enter_point;
+    // Per action index, set when it leaves a point that another agent enters.
+    std::vector<char> shared_leave;
+    std::vector<int> finished_node_idx;
+    std::vector<std::deque<int>> enqueue_nodes_idx;
+    // Per agent, the first node not known to be ready.
+    std::vector<int> ready_frontier;
+};
@@ -1,88 +1,65 @@
 #include "ADG.h"
 
-ADG::ADG(const std::vector<std::vector<Action>>& plans) {
-    std::map<int, int> lastActionIndexByRobot;
+// Node layout before the hot/cold split, only kept to report the per-node memory saving.
+struct LegacyADGNode {
+    Action action;
+    int node_id;
+    std::vector<std::shared_ptr<Edge>> incomeEdges;
+    std::vector<std::shared_ptr<Edge>> outEdges;
+    bool has_valid_in_edge;
+};
+
+ADG::ADG(const std::vector<std::vector<Action>>& plans, const ADGOptions& options): options(options) {
     num_robots = static_cast <int> (plans.size());
-    finished_node_idx.resize(num_robots, -1);
-    enqueue_nodes_idx.resize(num_robots);
-    graph.resize(num_robots);
     for (int i = 0; i < num_robots; i++) {
-        int j = 0;
-        for (const auto& action : plans[i]) {
-            ADGNode node {action, j, {}, {}};
-            graph[i].push_back(node);
-            j++;
-            total_nodes_cnt ++;
-        }
-    }
-    std::vector<std::vector<bool>> conflict_pair_table;
-    conflict_pair_table.resize(plans.size());
-    for (auto& tmp_entry: conflict_pair_table) {
-        tmp_entry.resize(plans.size(), false);
+        total_nodes_cnt += static_cast<int>(plans[i].size());
     }
 
     for (int i = 0; i < plans.size(); i++) {
         adg_stats.type1EdgeCount += static_cast<int>(plans[i].size()) - 1;
-        adg_stats.totalNodes += static_cast<int>(plans[i].size());
-        bool consecutive_move = false;
-        for (int j = 0; j < plans[i].size(); j++) {
-            if (plans[i][j].type == 'M') {
-                adg_stats.moveActionCount++;
-                if (not consecutive_move) {
-                    consecutive_move = true;
-                    adg_stats.consecutiveMoveSequences++;
-                }
-            } else if (plans[i][j].type == 'T') {
-                adg_stats.rotateActionCount++;
-                consecutive_move = false;
-            } else {
-                std::cerr << "Invalid type!\n" << std::endl;
-                consecutive_move = false;
+        countActions(plans[i], false);
+    }
+    // Coordinates stay exact at half cells and at the end points of split moves.
+    action_store.build(plans, std::lcm(2, options.move_splits));
+    if (options.type2_edges) {
+        buildType2Edges(options.num_threads);
+    } else {
+        edge_store.build(action_store.size(), {});
+    }
+
+    // Per-run counters are not part of the graph, they count under execution state bytes.
+    adg_stats.legacyBytesPerNode = static_cast<int>(sizeof(LegacyADGNode));
+    adg_stats.hotBytesPerNode = total_nodes_cnt > 0 ?
+                                static_cast<int>(edge_store.nodeBytes() / total_nodes_cnt) : 0;
+    adg_stats.coldBytesPerNode = static_cast<int>(ActionStore::BYTES_PER_ACTION);
+    buildRobotNames();
+}
+
+void ADG::countActions(const std::vector<Action>& actions, bool consecutive_move) {
+    adg_stats.totalNodes += static_cast<int>(actions.size());
+    for (const auto& action: actions) {
+        if (action.type == 'M') {
+            adg_stats.moveActionCount++;
+            if (action.reverse) {
+                adg_stats.reverseMoveCount++;
             }
-            for (int k = i+1; k < plans.size(); k++) {
-                for (int l = 0; l < plans[k].size(); l++) {
-                    bool found_conflict = false;
-                    if (plans[i][j].start == plans[k][l].goal && plans[i][j].time <= plans[k][l].time) {
-                        std::shared_ptr<Edge> tmp_edge = std::make_shared<Edge>(i, k, j, l);
-                        graph[i][j].outEdges.push_back(tmp_edge);
-                        graph[k][l].incomeEdges.push_back(tmp_edge);
-                        found_conflict = true;
-                    }
-                    else if (plans[k][l].start == plans[i][j].goal && plans[k][l].time <= plans[i][j].time) {
-                        std::shared_ptr<Edge> tmp_edge = std::make_shared<Edge>(k, i, l, j);
-                        graph[i][j].incomeEdges.push_back(tmp_edge);
-                        graph[k][l].outEdges.push_back(tmp_edge);
-                        found_conflict = true;
-                    }
-                    if (found_conflict) {
-                        if (i==0 and k==2) {
-                            printf("Agents %d and %d collide at action [(%f, %f)->(%f, %f)] and action [(%f, %f)->(%f, %f)]\n",
-                                i, k,
-                                plans[i][j].start.first, plans[i][j].start.second,
-                                plans[i][j].goal.first, plans[i][j].goal.second,
-                                plans[k][l].start.first, plans[k][l].start.second,
-                                plans[k][l].goal.first, plans[k][l].goal.second);
-                        }
-                        adg_stats.type2EdgeCount++;
-                        if (not conflict_pair_table[i][k]) {
-                            conflict_pair_table[i][k] = true;
-                            conflict_pair_table[k][i] = true;
-                            adg_stats.conflict_pairs.emplace(i, k);
-                        }
-                    }
-                }
+            if (not consecutive_move) {
+                consecutive_move = true;
+                adg_stats.consecutiveMoveSequences++;
             }
+        } else if (action.type == 'T') {
+            adg_stats.rotateActionCount++;
+            consecutive_move = false;
+        } else {
+            std::cerr << "Invalid type!\n" << std::endl;
+            consecutive_move = false;
         }
     }
 }
 
-void printEdge()
-{
-}
-
-std::pair<std::map<int, std::string>, std::map<std::string, int>> ADG::createRobotIDToStartIndexMaps() {
+void ADG::buildRobotNames() {
     for (int robot_id = 0; robot_id < num_robots; robot_id++) {
-        auto start = graph[robot_id][0].action.start;
+        auto start = action_store.startPoint(action_store.index(robot_id, 0));
         std::ostringstream oss;
         oss << static_cast<int>(start.first) << "_"
             << static_cast<int>(start.second);
@@ -91,110 +68,413 @@ std::pair<std::map<int, std::string>, std::map<std::string, int>> ADG::createRob
         robotIDToStartIndex[robot_id] = startStr;
         startIndexToRobotID[startStr] = robot_id;
     }
+}
 
-    return {robotIDToStartIndex, startIndexToRobotID};
+void ADG::writeSnapshot(SnapshotWriter& writer) const {
+    writer.value(options.reduce_type2_edges);
+    writer.value(options.prune_turn_edges);
+    writer.value(options.type2_edges);
+    action_store.writeSnapshot(writer);
+    edge_store.writeSnapshot(writer);
+    for (int count: {adg_stats.type1EdgeCount, adg_stats.type2EdgeCount, adg_stats.reducedType2EdgeCount,
+                     adg_stats.prunedTurnEdgeCount,
+                     adg_stats.moveActionCount, adg_stats.rotateActionCount, adg_stats.reverseMoveCount,
+                     adg_stats.consecutiveMoveSequences,
+                     adg_stats.totalNodes, adg_stats.legacyBytesPerNode, adg_stats.hotBytesPerNode,
+                     adg_stats.coldBytesPerNode}) {
+        writer.value(count);
+    }
+    std::vector<int> flat_pairs;
+    flat_pairs.reserve(2 * adg_stats.conflict_pairs.size());
+    for (const auto& [i, k]: adg_stats.conflict_pairs) {
+        flat_pairs.push_back(i);
+        flat_pairs.push_back(k);
+    }
+    writer.array(flat_pairs);
 }
 
-void inline updateADGNode(ADGNode& tmp_node) {
-    bool valid = false;
-    for (auto& tmp_in_edge: tmp_node.incomeEdges) {
-        if (tmp_in_edge->valid) {
-            valid = true;
-            break;
+std::shared_ptr<ADG> ADG::readSnapshot(SnapshotReader& reader) {
+    std::shared_ptr<ADG> adg(new ADG());
+    if (not reader.value(adg->options.reduce_type2_edges) or not reader.value(adg->options.prune_turn_edges) or
+        not reader.value(adg->options.type2_edges) or
+        not adg->action_store.readSnapshot(reader) or
+        not adg->edge_store.readSnapshot(reader, adg->action_store.size())) {
+        return nullptr;
+    }
+    auto& stats = adg->adg_stats;
+    for (int* count: {&stats.type1EdgeCount, &stats.type2EdgeCount, &stats.reducedType2EdgeCount,
+                      &stats.prunedTurnEdgeCount,
+                      &stats.moveActionCount, &stats.rotateActionCount, &stats.reverseMoveCount,
+                      &stats.consecutiveMoveSequences,
+                      &stats.totalNodes, &stats.legacyBytesPerNode, &stats.hotBytesPerNode,
+                      &stats.coldBytesPerNode}) {
+        if (not reader.value(*count)) {
+            return nullptr;
         }
     }
-    tmp_node.has_valid_in_edge = valid;
+    std::vector<int> flat_pairs;
+    if (not reader.array(flat_pairs) or flat_pairs.size() % 2 != 0) {
+        return nullptr;
+    }
+    for (size_t p = 0; p < flat_pairs.size(); p += 2) {
+        stats.conflict_pairs.emplace_back(flat_pairs[p], flat_pairs[p+1]);
+    }
+    adg->num_robots = static_cast<int>(adg->action_store.node_offset.size()) - 1;
+    adg->total_nodes_cnt = adg->action_store.size();
+    adg->buildRobotNames();
+    return adg;
 }
 
-bool ADG::getAvailableNodes(int robot_id, std::vector<int>& available_nodes) {
-    auto& curr_agent_plan = graph[robot_id];
-    int latest_finished_idx = finished_node_idx[robot_id];
-    int next_node_idx = latest_finished_idx + 1;
-    for (int i = next_node_idx; i < curr_agent_plan.size(); i++) {
-        if (curr_agent_plan[i].has_valid_in_edge) {
-            updateADGNode(curr_agent_plan[i]);
+void ADG::scanCell(const CellIndex& cell_index, const CellIndex::Cell& cell,
+                   std::vector<Type2EdgeRecord>& type2_edges) const {
+    const double* enter_time = cell_index.enter_time.data();
+    std::vector<int> matches(cell.enter_end - cell.enter_begin);
+    for (int l = cell.leave_begin; l < cell.leave_end; l++) {
+        int leave_idx = cell_index.leaving[l];
+        int leave_agent = action_store.agent_id[leave_idx];
+        int leave_node = action_store.nodeOf(leave_idx);
+        double leave_time = action_store.time[leave_idx];
+        int first_enter = static_cast<int>(std::lower_bound(enter_time + cell.enter_begin, enter_time + cell.enter_end,
+            leave_time) - enter_time);
+        int tie_end = static_cast<int>(std::upper_bound(enter_time + first_enter, enter_time + cell.enter_end,
+            leave_time) - enter_time);
+        int cnt = matchEnteringActions(cell_index.enter_agent.data(), cell_index.enter_start_x.data(),
+            cell_index.enter_start_y.data(), first_enter, tie_end, cell.enter_end,
+            leave_agent, action_store.goal_x[leave_idx], action_store.goal_y[leave_idx], matches.data());
+        for (int m = 0; m < cnt; m++) {
+            int enter_idx = cell_index.entering[matches[m]];
+            type2_edges.push_back({leave_agent, leave_node, action_store.agent_id[enter_idx],
+                                   action_store.nodeOf(enter_idx)});
         }
+    }
+}
 
-        if (curr_agent_plan[i].has_valid_in_edge) {
-            break;
+/*
+ * Type-2 edge (k, l) -> (i, j) exists when action l of agent k leaves the cell that action j of
+ * agent i enters, no later than j starts. Instead of comparing every pair of actions, group the
+ * actions by the cell they leave and enter, sort each group by time and only walk the entering
+ * actions that happen at or after each leaving action. Cells are scanned by num_threads workers.
+ */
+void ADG::buildType2Edges(int num_threads) {
+    CellIndex cell_index;
+    cell_index.build(action_store);
+    const auto& cells = cell_index.cells;
+
+    auto scan_order = [](const Type2EdgeRecord& a, const Type2EdgeRecord& b) {
+        return a.scanKey() < b.scanKey();
+    };
+    // Cells are independent, so workers pull cells from a shared counter and sort their own edges.
+    num_threads = std::max(1, std::min(num_threads, static_cast<int>(cells.size())));
+    std::vector<std::vector<Type2EdgeRecord>> thread_edges(num_threads);
+    std::atomic<size_t> next_cell {0};
+    auto worker = [&](int thread_id) {
+        auto& local_edges = thread_edges[thread_id];
+        for (size_t c = next_cell++; c < cells.size(); c = next_cell++) {
+            scanCell(cell_index, cells[c], local_edges);
+        }
+        std::sort(local_edges.begin(), local_edges.end(), scan_order);
+    };
+    if (num_threads == 1) {
+        worker(0);
+    } else {
+        std::vector<std::thread> workers;
+        for (int t = 0; t < num_threads; t++) {
+            workers.emplace_back(worker, t);
         }
+        for (auto& tmp_worker: workers) {
+            tmp_worker.join();
+        }
+    }
 
-        if (enqueue_nodes_idx[robot_id].empty() or enqueue_nodes_idx[robot_id].back() < i) {
-            available_nodes.push_back(i);
+    // The scan order is a total order on edges, so the merged list does not depend on the thread count
+    // and the per-node edge order stays identical to the pairwise agent scan.
+    std::vector<Type2EdgeRecord> type2_edges = std::move(thread_edges[0]);
+    for (int t = 1; t < num_threads; t++) {
+        std::vector<Type2EdgeRecord> merged;
+        merged.reserve(type2_edges.size() + thread_edges[t].size());
+        std::merge(type2_edges.begin(), type2_edges.end(), thread_edges[t].begin(), thread_edges[t].end(),
+                   std::back_inserter(merged), scan_order);
+        type2_edges.swap(merged);
+        std::vector<Type2EdgeRecord>().swap(thread_edges[t]);
+    }
+    adg_stats.type2EdgeCount = static_cast<int>(type2_edges.size());
+    if (options.prune_turn_edges) {
+        adg_stats.prunedTurnEdgeCount = pruneTurnEdges(type2_edges);
+    }
+    if (options.reduce_type2_edges) {
+        reduceType2Edges(type2_edges);
+    }
+    adg_stats.reducedType2EdgeCount = static_cast<int>(type2_edges.size());
+
+    adg_stats.conflict_pairs.clear();
+    addConflictPairs(type2_edges);
+    std::vector<std::pair<int, int>> edge_nodes;
+    edge_nodes.reserve(type2_edges.size());
+    for (const auto& record: type2_edges) {
+        edge_nodes.emplace_back(action_store.index(record.from_agent, record.from_node),
+                                action_store.index(record.to_agent, record.to_node));
+    }
+    edge_store.build(action_store.size(), edge_nodes);
+}
+
+// Agent pairs are collected per edge, then sorted and deduplicated instead of using an N x N table.
+void ADG::addConflictPairs(const std::vector<Type2EdgeRecord>& type2_edges) {
+    auto& conflict_pairs = adg_stats.conflict_pairs;
+    for (const auto& record: type2_edges) {
+        std::pair<int, int> agent_pair(std::min(record.from_agent, record.to_agent),
+                                       std::max(record.from_agent, record.to_agent));
+        // Edges come in scan order, so repeats of the same pair are mostly adjacent.
+        if (conflict_pairs.empty() or conflict_pairs.back() != agent_pair) {
+            conflict_pairs.push_back(agent_pair);
         }
     }
-    return true;
+    std::sort(conflict_pairs.begin(), conflict_pairs.end());
+    conflict_pairs.erase(std::unique(conflict_pairs.begin(), conflict_pairs.end()), conflict_pairs.end());
+    conflict_pairs.shrink_to_fit();
 }
 
-bool ADG::updateFinishedNode(int robot_id, int node_id) {
-    int latest_finished_idx = finished_node_idx[robot_id];
-    if (node_id <= latest_finished_idx) {
-        std::cerr << "Reconfirming nodes!" << std::endl;
-        return true;
-    } else {
-        if (not enqueue_nodes_idx[robot_id].empty() and node_id > enqueue_nodes_idx[robot_id].back()) {
-            std::cerr << "Confirm for nodes never enqueue!" << std::endl;
-            return false;
-        } else {
-            for (int tmp_idx = latest_finished_idx+1; tmp_idx <= node_id; tmp_idx++) {
-                for (auto& tmp_edge: graph[robot_id][tmp_idx].incomeEdges) {
-                    assert(not tmp_edge->valid);
-                }
-
-                for (auto& tmp_edge: graph[robot_id][tmp_idx].outEdges) {
-                    tmp_edge->valid = false;
-                }
-            }
-            finished_node_idx[robot_id] = node_id;
-            while(not enqueue_nodes_idx[robot_id].empty()) {
-                if (enqueue_nodes_idx[robot_id].front() <= node_id) {
-                    enqueue_nodes_idx[robot_id].pop_front();
-                } else {
-                    break;
-                }
-            }
-            return true;
+/*
+ * Only cells that a new action leaves or enters are scanned, over the new actions and the unfinished
+ * existing ones, and only edges with a new endpoint are kept. An edge from a finished node is already
+ * satisfied. An edge into a node that was already released can no longer hold it back, so it is dropped
+ * with a warning; that only happens when a segment starts earlier than the plans it has to follow.
+ */
+std::shared_ptr<ADG> ADG::extend(const std::vector<std::vector<Action>>& segments,
+                                 const std::vector<int>& first_unfinished,
+                                 const std::vector<int>& first_unreleased) const {
+    std::shared_ptr<ADG> next(new ADG(*this));
+    ActionStore& next_actions = next->action_store;
+    next_actions.append(segments);
+    next->total_nodes_cnt = next_actions.size();
+    for (int i = 0; i < num_robots; i++) {
+        if (segments[i].empty()) {
+            continue;
+        }
+        int old_size = action_store.planSize(i);
+        next->adg_stats.type1EdgeCount += static_cast<int>(segments[i].size()) - (old_size == 0 ? 1 : 0);
+        bool after_move = old_size > 0 and action_store.type[action_store.index(i, old_size - 1)] == 'M';
+        next->countActions(segments[i], after_move);
+    }
+
+    auto is_new = [this, &next_actions](int idx) {
+        int agent = next_actions.agent_id[idx];
+        return next_actions.nodeOf(idx) >= action_store.planSize(agent);
+    };
+    std::vector<int> candidates;
+    for (int i = 0; i < num_robots; i++) {
+        for (int idx = next_actions.index(i, first_unfinished[i]); idx < next_actions.node_offset[i+1]; idx++) {
+            candidates.push_back(idx);
         }
     }
+    CellIndex cell_index;
+    cell_index.build(next_actions, std::move(candidates));
+    std::vector<Type2EdgeRecord> type2_edges;
+    for (const auto& cell: cell_index.cells) {
+        bool touches_new = false;
+        for (int l = cell.leave_begin; l < cell.leave_end and not touches_new; l++) {
+            touches_new = is_new(cell_index.leaving[l]);
+        }
+        for (int e = cell.enter_begin; e < cell.enter_end and not touches_new; e++) {
+            touches_new = is_new(cell_index.entering[e]);
+        }
+        if (touches_new) {
+            next->scanCell(cell_index, cell, type2_edges);
+        }
+    }
+
+    int dropped = 0;
+    size_t kept = 0;
+    for (const auto& record: type2_edges) {
+        bool new_from = record.from_node >= action_store.planSize(record.from_agent);
+        bool new_to = record.to_node >= action_store.planSize(record.to_agent);
+        if (not new_from and not new_to) {
+            continue;
+        }
+        if (not new_to and record.to_node < first_unreleased[record.to_agent]) {
+            dropped++;
+            continue;
+        }
+        type2_edges[kept++] = record;
+    }
+    type2_edges.resize(kept);
+    if (dropped > 0) {
+        std::cerr << "Dropped " << dropped << " type-2 edges into already released nodes while extending the ADG." << std::endl;
+    }
+    std::sort(type2_edges.begin(), type2_edges.end(), [](const Type2EdgeRecord& a, const Type2EdgeRecord& b) {
+        return a.scanKey() < b.scanKey();
+    });
+    next->adg_stats.type2EdgeCount += static_cast<int>(type2_edges.size());
+    if (options.prune_turn_edges) {
+        next->adg_stats.prunedTurnEdgeCount += next->pruneTurnEdges(type2_edges);
+    }
+    if (options.reduce_type2_edges) {
+        reduceType2Edges(type2_edges);
+    }
+    next->adg_stats.reducedType2EdgeCount += static_cast<int>(type2_edges.size());
+    next->addConflictPairs(type2_edges);
+
+    // Existing edges go first and in their old order, which ExecutionState::rebase relies on.
+    std::vector<std::pair<int, int>> edge_nodes;
+    edge_nodes.reserve(edge_store.numEdges() + type2_edges.size());
+    for (int v = 0; v < action_store.size(); v++) {
+        int from = next_actions.index(action_store.agent_id[v], action_store.nodeOf(v));
+        for (int e = edge_store.outBegin(v); e < edge_store.outEnd(v); e++) {
+            int to = edge_store.target(e);
+            edge_nodes.emplace_back(from, next_actions.index(action_store.agent_id[to], action_store.nodeOf(to)));
+        }
+    }
+    for (const auto& record: type2_edges) {
+        edge_nodes.emplace_back(next_actions.index(record.from_agent, record.from_node),
+                                next_actions.index(record.to_agent, record.to_node));
+    }
+    next->edge_store.build(next_actions.size(), edge_nodes);
+    return next;
 }
 
-void ADG::setEnqueueNodes(int robot_id, std::vector<int>& enqueue_nodes) {
-    auto& curr_enqueue = enqueue_nodes_idx[robot_id];
-    if (curr_enqueue.empty()) {
-        curr_enqueue.insert(curr_enqueue.end(), enqueue_nodes.begin(), enqueue_nodes.end());
-    } else {
-        int i = 0;
-        for (i = 0; i < enqueue_nodes.size(); i++) {
-            if (enqueue_nodes[i] > curr_enqueue.back()) {
-                break;
+std::shared_ptr<ADG> ADG::compact(const std::vector<int>& first_kept) const {
+    std::shared_ptr<ADG> next(new ADG());
+    next->options = options;
+    next->adg_stats = adg_stats;
+    next->num_robots = num_robots;
+    next->robotIDToStartIndex = robotIDToStartIndex;
+    next->startIndexToRobotID = startIndexToRobotID;
+    ActionStore& next_actions = next->action_store;
+    next_actions = action_store;
+    next_actions.dropBefore(first_kept);
+    next->total_nodes_cnt = next_actions.size();
+
+    // Kept edges stay in their old order, which ExecutionState::rebase relies on.
+    auto kept = [this, &first_kept](int v) {
+        return action_store.nodeOf(v) >= first_kept[action_store.agent_id[v]];
+    };
+    std::vector<std::pair<int, int>> edge_nodes;
+    for (int v = 0; v < action_store.size(); v++) {
+        if (not kept(v)) {
+            continue;
+        }
+        int from = next_actions.index(action_store.agent_id[v], action_store.nodeOf(v));
+        for (int e = edge_store.outBegin(v); e < edge_store.outEnd(v); e++) {
+            int to = edge_store.target(e);
+            if (kept(to)) {
+                edge_nodes.emplace_back(from, next_actions.index(action_store.agent_id[to], action_store.nodeOf(to)));
             }
         }
-        curr_enqueue.insert(curr_enqueue.end(), enqueue_nodes.begin()+i, enqueue_nodes.end());
     }
+    next->edge_store.build(next_actions.size(), edge_nodes);
+    return next;
+}
+
+/*
+ * Edge (a, i) -> (b, j) is implied by any other edge (a, i') -> (b, j') with i' >= i and j' <= j, since
+ * the type-1 chains give a path (a, i) -> (a, i') -> (b, j') -> (b, j). Walking the edges of one agent
+ * pair by decreasing i and increasing j, an edge is implied as soon as an earlier one reached j' <= j.
+ * Reachability, and hence execution order, is unchanged. Surviving edges keep their scan order.
+ */
+void ADG::reduceType2Edges(std::vector<Type2EdgeRecord>& type2_edges) {
+    std::vector<int> order(type2_edges.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&type2_edges](int x, int y) {
+        const auto& a = type2_edges[x];
+        const auto& b = type2_edges[y];
+        return std::make_tuple(a.from_agent, a.to_agent, -a.from_node, a.to_node) <
+               std::make_tuple(b.from_agent, b.to_agent, -b.from_node, b.to_node);
+    });
+    std::vector<bool> implied(type2_edges.size(), false);
+    int min_to_node = 0;
+    for (size_t k = 0; k < order.size(); k++) {
+        const auto& edge = type2_edges[order[k]];
+        bool new_pair = k == 0 or type2_edges[order[k-1]].from_agent != edge.from_agent or
+                        type2_edges[order[k-1]].to_agent != edge.to_agent;
+        if (not new_pair and min_to_node <= edge.to_node) {
+            implied[order[k]] = true;
+        } else {
+            min_to_node = edge.to_node;
+        }
+    }
+    size_t kept = 0;
+    for (size_t k = 0; k < type2_edges.size(); k++) {
+        if (not implied[k]) {
+            type2_edges[kept++] = type2_edges[k];
+        }
+    }
+    type2_edges.resize(kept);
 }
 
-void ADG::findConstraining(int robot_id) {
-    auto& curr_agent_plan = graph[robot_id];
-    int latest_finished_idx = finished_node_idx[robot_id];
-    int next_node_idx = latest_finished_idx + 1;
-    for (int i = next_node_idx; i < curr_agent_plan.size(); i++) {
-        if (curr_agent_plan[i].has_valid_in_edge) {
-            updateADGNode(curr_agent_plan[i]);
+/*
+ * A turn stands on the cell its agent entered with the move before it and leaves with the move after
+ * it. Edge (a, t) -> (b, j) out of turn t is implied by an edge (a, t+1) -> (b, j') with j' <= j, and
+ * edge (a, i) -> (b, t) into turn t by an edge (a, i') -> (b, t-1) with i' >= i, through the type-1
+ * chains. Implying edges always have a later source or an earlier target, as in reduceType2Edges, so
+ * all implied edges can be dropped at once without changing reachability.
+ */
+int ADG::pruneTurnEdges(std::vector<Type2EdgeRecord>& type2_edges) const {
+    auto type_of = [this](int agent, int node) {
+        if (node < action_store.first_node[agent] or node >= action_store.planSize(agent)) {
+            return '\0';
+        }
+        return action_store.type[action_store.index(agent, node)];
+    };
+    // Edges out of a move right after a turn, keyed by source and target agent, and edges into a move
+    // right before a turn, keyed by target and source agent with the source node negated.
+    std::vector<std::tuple<int, int, int, int>> after_turn;
+    std::vector<std::tuple<int, int, int, int>> before_turn;
+    for (const auto& edge: type2_edges) {
+        if (type_of(edge.from_agent, edge.from_node) == 'M' and type_of(edge.from_agent, edge.from_node - 1) == 'T') {
+            after_turn.emplace_back(edge.from_agent, edge.from_node, edge.to_agent, edge.to_node);
+        }
+        if (type_of(edge.to_agent, edge.to_node) == 'M' and type_of(edge.to_agent, edge.to_node + 1) == 'T') {
+            before_turn.emplace_back(edge.to_agent, edge.to_node, edge.from_agent, -edge.from_node);
         }
+    }
+    std::sort(after_turn.begin(), after_turn.end());
+    std::sort(before_turn.begin(), before_turn.end());
+    // Whether keys holds an entry starting with (a, b, c) whose last field is at most bound.
+    auto covered = [](const std::vector<std::tuple<int, int, int, int>>& keys, int a, int b, int c, int bound) {
+        auto it = std::lower_bound(keys.begin(), keys.end(), std::make_tuple(a, b, c, INT_MIN));
+        return it != keys.end() and std::get<0>(*it) == a and std::get<1>(*it) == b and std::get<2>(*it) == c and
+               std::get<3>(*it) <= bound;
+    };
 
-        if (curr_agent_plan[i].has_valid_in_edge) {
-            std::cout << "Constraining idx: " << i << ";";
-            for (auto tmp_edge: curr_agent_plan[i].incomeEdges) {
-                if (tmp_edge->valid) {
-                    std::cout << " Constraint Agent " << tmp_edge->from_agent_id << " at node " << tmp_edge->from_node_id << ";";
-                }
-            }
-            break;
+    size_t kept = 0;
+    for (const auto& edge: type2_edges) {
+        bool implied = (type_of(edge.from_agent, edge.from_node) == 'T' and
+                        covered(after_turn, edge.from_agent, edge.from_node + 1, edge.to_agent, edge.to_node)) or
+                       (type_of(edge.to_agent, edge.to_node) == 'T' and
+                        covered(before_turn, edge.to_agent, edge.to_node - 1, edge.from_agent, -edge.from_node));
+        if (not implied) {
+            type2_edges[kept++] = edge;
         }
     }
+    int pruned = static_cast<int>(type2_edges.size() - kept);
+    type2_edges.resize(kept);
+    return pruned;
 }
 
-void ADG::printActions(const std::vector<std::tuple<std::string, int, double, std::string, std::pair<double, double>, std::pair<double, double>>>& actions) {
+void printEdge()
+{
+}
+
+std::vector<Edge> ADG::getIncomeEdges(int robot_id, int node_id) const {
+    std::vector<Edge> edges;
+    int v = action_store.index(robot_id, node_id);
+    for (int k = edge_store.inBegin(v); k < edge_store.inEnd(v); k++) {
+        int from = edge_store.inSource(k);
+        edges.emplace_back(action_store.agent_id[from], robot_id, action_store.nodeOf(from), node_id);
+    }
+    return edges;
+}
+
+std::vector<Edge> ADG::getOutEdges(int robot_id, int node_id) const {
+    std::vector<Edge> edges;
+    int v = action_store.index(robot_id, node_id);
+    for (int e = edge_store.outBegin(v); e < edge_store.outEnd(v); e++) {
+        int to = edge_store.target(e);
+        edges.emplace_back(robot_id, action_store.agent_id[to], node_id, action_store.nodeOf(to));
+    }
+    return edges;
+}
+
+void ADG::printActions(const SIM_PLAN& actions) {
     for (const auto& action : actions) {
         std::string robot_id = std::get<0>(action);
         int time = std::get<1>(action);
@@ -212,15 +492,3 @@ void ADG::printActions(const std::vector<std::tuple<std::string, int, double, st
                   << std::endl;
     }
 }
-
-SIM_PLAN ADG::getPlan(int agent_id) {
-    SIM_PLAN sim_plan;
-    std::vector<int> enque_acts;
-    getAvailableNodes(agent_id, enque_acts);
-    for (int enque_id: enque_acts) {
-        const Action& action = graph[agent_id][enque_id].action;
-        sim_plan.emplace_back(robotIDToStartIndex[action.robot_id], enque_id, action.orientation, std::string(1, action.type), action.start, action.goal);
-        enqueue_nodes_idx[agent_id].push_back(enque_id);
-    }
-    return sim_plan;
-}
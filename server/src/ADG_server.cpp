@@ -1,5 +1,8 @@
 #include "ADG_server.h"
 #include <iomanip>
+#include <cstdio>
+#include <future>
+#include <unistd.h>
 
 std::vector<std::chrono::steady_clock::time_point> startTimers; // Start times for each robot
     // =======================
@@ -10,22 +13,86 @@ ADG_Server::ADG_Server(std::string &path_filename,
     std::string scen_name,
     std::string method_name,
     bool flip_coord,
-    double sim_dt_seconds):
-path_filename_(path_filename), curr_map_name(map_name), curr_scen_name(scen_name), curr_method_name(method_name),
-sim_dt_seconds_(sim_dt_seconds)
+    double sim_dt_seconds,
+    const ADGOptions& adg_options,
+    const std::string& adg_cache_dir,
+    double adg_window,
+    int compact_interval,
+    bool switch_edges,
+    const DurationModel& durations,
+    bool critical_priority,
+    bool eta,
+    bool reverse_moves,
+    double platoon_gap,
+    int rpc_workers):
+curr_map_name(map_name), curr_scen_name(scen_name), curr_method_name(method_name), path_filename_(path_filename), flip_coord_(flip_coord), move_splits_(adg_options.move_splits), reverse_moves_(reverse_moves),
+compact_interval_(compact_interval), sim_dt_seconds_(sim_dt_seconds)
  {
     if (path_filename == "none") {
         std::cerr << "No path file provided, exiting ..." << std::endl;
         exit(-1);
-    } else {
-        bool success = parseEntirePlan(path_filename, plans, raw_plan_cost, flip_coord);
+    }
+    if (critical_priority and not switch_edges) {
+        std::cerr << "Critical path priority only applies to switched edges, exiting ..." << std::endl;
+        exit(-1);
+    }
+    // A removed edge is only implied through the edges left, and switching may reverse exactly those.
+    if (switch_edges and (adg_options.reduce_type2_edges or adg_options.prune_turn_edges)) {
+        std::cerr << "Switching edges needs every type-2 edge, it cannot be combined with reduce_edges or "
+                     "prune_turn_edges, exiting ..." << std::endl;
+        exit(-1);
+    }
+    if (adg_window > 0.0 and not adg_cache_dir.empty()) {
+        std::cerr << "ADG snapshots hold complete graphs, they cannot be combined with a window, exiting ..." << std::endl;
+        exit(-1);
+    }
+
+    uint64_t snapshot_key = 0;
+    std::string snapshot_filename;
+    if (not adg_cache_dir.empty()) {
+        snapshot_key = snapshotKey(flip_coord, adg_options);
+        std::ostringstream oss;
+        oss << adg_cache_dir << "/adg_" << std::hex << std::setw(16) << std::setfill('0') << snapshot_key << ".bin";
+        snapshot_filename = oss.str();
+        if (loadSnapshot(snapshot_filename, snapshot_key)) {
+            std::cout << "Loaded ADG snapshot " << snapshot_filename << std::endl;
+        }
+    }
+
+    if (adg == nullptr) {
+        bool success = parseEntirePlan(path_filename, plans, raw_plan_cost, flip_coord, PlanType::CONTINUOUS,
+                                       adg_options.move_splits, reverse_moves);
         if (not success){
             std::cerr << "Incorrect path, no ADG constructed! exiting ..." << std::endl;
             exit(-1);
         }
+        if (adg_window > 0.0) {
+            plan_window = std::make_unique<PlanWindow>(adg_window, plans, std::lcm(2, adg_options.move_splits));
+            std::cout << "Materializing the ADG up to time " << plan_window->horizon() << ", " <<
+                plan_window->pendingCount() << " actions pending" << std::endl;
+        }
+        adg = std::make_shared<ADG> (plans, adg_options);
+        checkCycles(adg_options);
+        if (not snapshot_filename.empty()) {
+            saveSnapshot(snapshot_filename, snapshot_key);
+        }
     }
-
-    adg = std::make_shared<ADG> (plans);
+    if (adg_options.type2_edges) {
+        execution = std::make_shared<ExecutionState>(adg);
+        execution->enableSwitching(switch_edges);
+        execution->enablePlatoon(platoon_gap);
+        execution->enableCriticalPath(durations, critical_priority);
+        estimated_makespan = execution->criticalPath()->length(*execution);
+        critical_agents = execution->criticalPath()->criticalAgents(*execution);
+        if (eta) {
+            execution->enableEta(durations, [this]() {
+                return std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start).count();
+            });
+        }
+    } else {
+        visit_queues = std::make_unique<VisitQueueState>(adg);
+    }
+    trackGraphSize();
     output_filename = target_output_filename;
     numRobots = adg->numRobots();
     agent_finish_time.resize(numRobots, -1);
@@ -37,6 +104,288 @@ sim_dt_seconds_(sim_dt_seconds)
 
     outgoingEdgesByRobot.resize(numRobots);
     startTimers.resize(numRobots);
+    robot_mutexes = std::vector<std::mutex>(numRobots);
+    // The visit queues are shared by all robots visiting a cell. Switching moves other robots' edges, and
+    // window advances and compaction replace the graph every robot works on.
+    concurrent_ = rpc_workers > 1 and execution != nullptr and plan_window == nullptr and compact_interval <= 0 and
+                  not switch_edges;
+    if (rpc_workers > 1 and not concurrent_) {
+        std::cout << "Robots share more than their dependencies with this engine or options, serving one RPC at a time" <<
+            std::endl;
+    }
+}
+
+RobotLock ADG_Server::lockRobot(int robot_id) {
+    RobotLock lock;
+    if (concurrent_) {
+        lock.shared = std::shared_lock<std::shared_mutex>(server_mutex);
+        lock.robot = std::unique_lock<std::mutex>(robot_mutexes[robot_id]);
+    } else {
+        lock.exclusive = lockAll();
+    }
+    return lock;
+}
+
+/*
+ * Snapshots are keyed by the content of the path file, the coordinate order and every option that
+ * changes the built graph, so editing the plan or the build settings never reuses a stale file.
+ */
+uint64_t ADG_Server::snapshotKey(bool flip_coord, const ADGOptions& adg_options) const {
+    MappedFile path_file(path_filename_);
+    if (not path_file.valid()) {
+        std::cerr << "Failed to map the path file, ADG snapshot disabled." << std::endl;
+        return 0;
+    }
+    uint64_t key = fnv1aHash(path_file.data(), path_file.size());
+    key = fnv1aHash(reinterpret_cast<const char*>(&SNAPSHOT_VERSION), sizeof(SNAPSHOT_VERSION), key);
+    key = fnv1aHash(reinterpret_cast<const char*>(&adg_options.move_splits), sizeof(adg_options.move_splits), key);
+    const char settings[] = {static_cast<char>(flip_coord),
+                             static_cast<char>(adg_options.reduce_type2_edges),
+                             static_cast<char>(adg_options.prune_turn_edges),
+                             static_cast<char>(adg_options.cycle_check),
+                             static_cast<char>(adg_options.type2_edges),
+                             static_cast<char>(reverse_moves_)};
+    return fnv1aHash(settings, sizeof(settings), key);
+}
+
+bool ADG_Server::loadSnapshot(const std::string& filename, uint64_t key) {
+    MappedFile snapshot(filename);
+    if (key == 0 or not snapshot.valid()) {
+        return false;
+    }
+    SnapshotReader reader(snapshot.data(), snapshot.size());
+    uint64_t magic = 0, stored_key = 0;
+    uint32_t version = 0;
+    double stored_cost = 0.0;
+    int stored_cycle_edges = 0;
+    if (not (reader.value(magic) and reader.value(version) and reader.value(stored_key) and reader.value(stored_cost) and
+             reader.value(stored_cycle_edges)) or
+        magic != SNAPSHOT_MAGIC or version != SNAPSHOT_VERSION or stored_key != key) {
+        return false;
+    }
+    adg = ADG::readSnapshot(reader);
+    if (adg == nullptr) {
+        std::cerr << "Corrupted ADG snapshot " << filename << ", rebuilding ..." << std::endl;
+        return false;
+    }
+    raw_plan_cost = stored_cost;
+    cycle_edges_removed = stored_cycle_edges;
+    plans = adg->actions().toPlans();
+    return true;
+}
+
+void ADG_Server::saveSnapshot(const std::string& filename, uint64_t key) const {
+    if (key == 0) {
+        return;
+    }
+    // Write next to the target and rename, so concurrent runs never map a half-written file.
+    std::string tmp_filename = filename + ".tmp" + std::to_string(getpid());
+    {
+        SnapshotWriter writer(tmp_filename);
+        writer.value(SNAPSHOT_MAGIC);
+        writer.value(SNAPSHOT_VERSION);
+        writer.value(key);
+        writer.value(raw_plan_cost);
+        writer.value(cycle_edges_removed);
+        adg->writeSnapshot(writer);
+        if (not writer.good()) {
+            std::cerr << "Failed to write ADG snapshot " << filename << std::endl;
+            std::remove(tmp_filename.c_str());
+            return;
+        }
+    }
+    if (std::rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+        std::cerr << "Failed to write ADG snapshot " << filename << std::endl;
+        std::remove(tmp_filename.c_str());
+    }
+}
+
+int ADG_Server::extendPlans(const std::map<std::string, std::string>& segments) {
+    if (visit_queues != nullptr) {
+        std::cerr << "Plan extension needs the ADG engine, ignored." << std::endl;
+        return -1;
+    }
+    const ActionStore& actions = adg->actions();
+    std::vector<std::vector<Action>> new_actions(numRobots);
+    int appended = 0;
+    for (const auto& [robot_name, line]: segments) {
+        auto robot = startIndexToRobotID.find(robot_name);
+        if (robot == startIndexToRobotID.end()) {
+            std::cerr << "Unknown robot " << robot_name << " in plan extension, ignored." << std::endl;
+            return -1;
+        }
+        int robot_id = robot->second;
+        int plan_size = actions.planSize(robot_id);
+        if (plan_size == 0) {
+            std::cerr << "Invalid plan extension for robot " << robot_name << ", ignored." << std::endl;
+            return -1;
+        }
+        int last = actions.index(robot_id, plan_size - 1);
+        Action last_action {robot_id, actions.time[last], static_cast<double>(actions.orientation(last)),
+                            actions.type[last], actions.startPoint(last), actions.goalPoint(last), last};
+        if (plan_window != nullptr and plan_window->hasPending(robot_id)) {
+            last_action = plan_window->lastPending(robot_id);
+        }
+        std::vector<Action> segment;
+        if (not parseSegment(line, robot_id, static_cast<int>(last_action.orientation), flip_coord_, segment,
+                              move_splits_, reverse_moves_)) {
+            std::cerr << "Invalid plan extension for robot " << robot_name << ", ignored." << std::endl;
+            return -1;
+        }
+        if (segment.empty()) {
+            continue;
+        }
+        if (segment.front().start != last_action.goal or segment.front().time < last_action.time) {
+            std::cerr << "Plan extension for robot " << robot_name << " does not continue its plan, ignored." << std::endl;
+            return -1;
+        }
+        for (const auto& action: segment) {
+            if (not actions.fits(action)) {
+                std::cerr << "Plan extension for robot " << robot_name << " does not fit the action store, ignored."
+                          << std::endl;
+                return -1;
+            }
+        }
+        appended += static_cast<int>(segment.size());
+        new_actions[robot_id] = std::move(segment);
+    }
+    if (appended == 0) {
+        return 0;
+    }
+
+    if (plan_window != nullptr) {
+        plan_window->append(new_actions);
+        advanceWindow();
+    } else {
+        std::vector<int> first_unfinished, first_unreleased;
+        execution->extensionBounds(first_unfinished, first_unreleased);
+        std::shared_ptr<const ADG> next = adg->extend(new_actions, first_unfinished, first_unreleased);
+        execution->rebase(next);
+        adg = next;
+        trackGraphSize();
+    }
+    for (int robot_id = 0; robot_id < numRobots; robot_id++) {
+        if (new_actions[robot_id].empty()) {
+            continue;
+        }
+        // The robot has work again; its finish time is taken when it ends the extended plan.
+        if (agents_finish[robot_id]) {
+            finished_agents--;
+        }
+        agents_finish[robot_id] = false;
+        agent_finish_time[robot_id] = -1;
+        agent_finish_sim_step[robot_id] = -1;
+        all_agents_finished = false;
+    }
+    return appended;
+}
+
+void ADG_Server::advanceWindow() {
+    if (plan_window != nullptr and plan_window->advance(*execution)) {
+        adg = execution->sharedGraph();
+        trackGraphSize();
+    }
+}
+
+void ADG_Server::compactIfDue() {
+    if (compact_interval_ > 0 and execution->deadNodes() >= compact_interval_ and execution->compact()) {
+        adg = execution->sharedGraph();
+        compaction_count++;
+    }
+}
+
+void ADG_Server::checkCycles(const ADGOptions& adg_options) {
+    if (adg_options.cycle_check == CycleCheck::OFF) {
+        return;
+    }
+    auto cycles = adg->findCycles(adg_options.num_threads);
+    if (cycles.empty()) {
+        return;
+    }
+    adg->printCycles(cycles);
+    if (adg_options.cycle_check == CycleCheck::REJECT) {
+        std::cerr << "The ADG has " << cycles.size() << " cycles and would deadlock, exiting ..." << std::endl;
+        exit(-1);
+    }
+    for (bool ties_only: {true, false}) {
+        int removed = 0;
+        adg = adg->breakCycles(cycles, ties_only, removed);
+        cycle_edges_removed += removed;
+        std::cerr << "Removed " << removed << (ties_only ? " same-time" : " larger-to-smaller agent") <<
+            " type-2 edges inside cycles" << std::endl;
+        cycles = adg->findCycles(adg_options.num_threads);
+        if (cycles.empty()) {
+            return;
+        }
+    }
+    std::cerr << "Failed to remove the cycles of the ADG, exiting ..." << std::endl;
+    exit(-1);
+}
+
+void ADG_Server::trackGraphSize() {
+    peak_graph_nodes = std::max(peak_graph_nodes, adg->numNodes());
+    peak_graph_edges = std::max(peak_graph_edges, adg->edges().numEdges());
+}
+
+double ADG_Server::estimatedFinishTime(int robot_id) const {
+    const EtaEngine* eta = execution != nullptr ? execution->etaEngine() : nullptr;
+    if (eta == nullptr) {
+        return -1.0;
+    }
+    if (isAgentFinished(robot_id)) {
+        return execution->eta(robot_id);
+    }
+    // Estimates only move when nodes finish; an agent that is late now finishes later than planned.
+    double now = std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start).count();
+    return std::max(execution->eta(robot_id), now);
+}
+
+bool ADG_Server::isAgentFinished(int robot_id) const {
+    if (visit_queues != nullptr) {
+        return visit_queues->isAgentFinished(robot_id);
+    }
+    return execution->isAgentFinished(robot_id) and (plan_window == nullptr or not plan_window->hasPending(robot_id));
+}
+
+SIM_PLAN ADG_Server::getPlan(int robot_id) {
+    return visit_queues != nullptr ? visit_queues->getPlan(robot_id) : execution->getPlan(robot_id);
+}
+
+/*
+ * A run continues past a node only when no other agent waits for it, so the robot confirming just the
+ * last node of the run, which confirms every node before it, holds back no one.
+ */
+MACRO_PLAN ADG_Server::getMacroPlan(int robot_id) {
+    SIM_PLAN plan = getPlan(robot_id);
+    const ActionStore& actions = execution != nullptr ? execution->graph().actions() : adg->actions();
+    auto has_waiters = [this](int idx) {
+        return visit_queues != nullptr ? visit_queues->hasWaiters(idx) : execution->hasWaiters(idx);
+    };
+    MACRO_PLAN macro_plan;
+    for (const auto& [name, node, orientation, type, start, goal]: plan) {
+        int idx = actions.index(robot_id, node);
+        int prev = idx - 1;
+        if (not macro_plan.empty() and std::get<2>(macro_plan.back()) == node - 1 and
+            actions.type[idx] == 'M' and actions.type[prev] == 'M' and actions.isReverse(idx) == actions.isReverse(prev) and
+            actions.goal_x[idx] - actions.start_x[idx] == actions.goal_x[prev] - actions.start_x[prev] and
+            actions.goal_y[idx] - actions.start_y[idx] == actions.goal_y[prev] - actions.start_y[prev] and
+            not has_waiters(prev)) {
+            std::get<2>(macro_plan.back()) = node;
+            std::get<6>(macro_plan.back()) = goal;
+        } else {
+            macro_plan.emplace_back(name, node, node, orientation, type, start, goal);
+        }
+    }
+    macro_segments += static_cast<int>(macro_plan.size());
+    macro_nodes += static_cast<int>(plan.size());
+    return macro_plan;
+}
+
+bool ADG_Server::updateFinishedNode(int robot_id, int node_id) {
+    if (visit_queues != nullptr) {
+        return visit_queues->updateFinishedNode(robot_id, node_id);
+    }
+    return execution->updateFinishedNode(robot_id, node_id);
 }
 
 void ADG_Server::saveStats() {
@@ -68,6 +417,16 @@ void ADG_Server::saveStats() {
         path_filename_ << "," << numRobots << endl;
     stats.close();
 
+    // Each switch as [x, y, agent that went first, agent that the original order let go first].
+    json switched = json::array();
+    if (execution != nullptr) {
+        for (const auto& order: execution->switchedOrders()) {
+            switched.push_back({order.point.first, order.point.second, order.first_agent, order.second_agent});
+        }
+    }
+    size_t state_bytes = visit_queues != nullptr ? visit_queues->memoryBytes() : execution->memoryBytes();
+    const EtaEngine* eta = execution != nullptr ? execution->etaEngine() : nullptr;
+
     json result = {
         {"steps finish sim", sim_makespan_steps},
         {"sum of steps finish sim", sim_sum_steps},
@@ -78,12 +437,30 @@ void ADG_Server::saveStats() {
         {"simulated sum of cost seconds", sim_sum_cost_seconds},
         {"simulated average sum of cost seconds", sim_avg_sum_cost_seconds},
         {"#type-2 edges", adg->adg_stats.type2EdgeCount},
+        {"#type-2 edges after reduction", adg->adg_stats.reducedType2EdgeCount},
+        {"#turn edges pruned", adg->adg_stats.prunedTurnEdgeCount},
         {"#type-1 edges", adg->adg_stats.type1EdgeCount},
         {"#Nodes", adg->adg_stats.totalNodes},
         {"#Move", adg->adg_stats.moveActionCount},
         {"#Rotate", adg->adg_stats.rotateActionCount},
+        {"#Reverse Move", adg->adg_stats.reverseMoveCount},
         {"#Consecutive Move", adg->adg_stats.consecutiveMoveSequences},
         {"#Agent pair", static_cast<int>(adg->adg_stats.conflict_pairs.size())},
+        {"node bytes before", adg->adg_stats.legacyBytesPerNode},
+        {"node bytes after", adg->adg_stats.hotBytesPerNode + adg->adg_stats.coldBytesPerNode},
+        {"execution state bytes", static_cast<int64_t>(state_bytes)},
+        {"peak ADG nodes", peak_graph_nodes},
+        {"peak ADG type-2 edges", peak_graph_edges},
+        {"ADG compactions", compaction_count},
+        {"#cycle edges removed", cycle_edges_removed},
+        {"#switched edges", static_cast<int>(switched.size())},
+        {"switched orders", switched},
+        {"#platoon releases", execution != nullptr ? execution->platoonReleases() : 0L},
+        {"#macro segments", macro_segments.load()},
+        {"#macro segment nodes", macro_nodes.load()},
+        {"estimated makespan", estimated_makespan},
+        {"critical agents", critical_agents},
+        {"#ETA estimates updated", eta != nullptr ? eta->updatedEstimates() : 0L},
         {"instance name", path_filename_},
         {"number of agent", numRobots}
     };
@@ -96,31 +473,30 @@ void ADG_Server::saveStats() {
     std::cout << "simulated makespan - " << sim_makespan_seconds << " s" << std::endl;
     std::cout << "simulated sum of cost - " << sim_sum_cost_seconds << " s" << std::endl;
     std::cout << "simulated average sum of cost - " << sim_avg_sum_cost_seconds << " s" << std::endl;
+    std::cout << "ADG node bytes - " << adg->adg_stats.hotBytesPerNode << " hot + " <<
+        adg->adg_stats.coldBytesPerNode << " cold, was " << adg->adg_stats.legacyBytesPerNode << std::endl;
 }
 
 
 std::shared_ptr<ADG_Server> server_ptr = nullptr;
 
-std::string receive_update(std::string& RobotID, int node_ID) {
-    std::lock_guard<std::mutex> guard(globalMutex);
-    int Robot_ID = server_ptr->startIndexToRobotID[RobotID];
-    bool status_update = server_ptr->adg->updateFinishedNode(Robot_ID, node_ID);
-    if (server_ptr->adg->isAgentFinished(Robot_ID)) {
+// receive_update for a robot whose lock is held.
+std::string confirmNode(int Robot_ID, int node_ID) {
+    bool status_update = server_ptr->updateFinishedNode(Robot_ID, node_ID);
+    server_ptr->advanceWindow();
+    server_ptr->compactIfDue();
+    if (server_ptr->isAgentFinished(Robot_ID)) {
         auto endTime = std::chrono::steady_clock::now();
         auto diff = endTime - startTimers[Robot_ID];
         double duration = std::chrono::duration_cast<std::chrono::duration<double>>(diff).count();
         if (server_ptr->agent_finish_time[Robot_ID] < 0) {
             server_ptr->agent_finish_time[Robot_ID] = duration;
             server_ptr->agents_finish[Robot_ID] = true;
+            server_ptr->finished_agents++;
         }
     }
 
-    server_ptr->all_agents_finished = true;
-    for (auto status: server_ptr->agents_finish) {
-        if (not status) {
-            server_ptr->all_agents_finished = false;
-        }
-    }
+    server_ptr->all_agents_finished = server_ptr->finished_agents == server_ptr->numRobots;
     if (server_ptr->all_agents_finished) {
         return "exit";
     }
@@ -130,9 +506,15 @@ std::string receive_update(std::string& RobotID, int node_ID) {
     return "None";
 }
 
+std::string receive_update(std::string& RobotID, int node_ID) {
+    int Robot_ID = server_ptr->startIndexToRobotID.at(RobotID);
+    RobotLock lock = server_ptr->lockRobot(Robot_ID);
+    return confirmNode(Robot_ID, node_ID);
+}
+
 std::vector<std::tuple<std::string, int, double, std::string, std::pair<double, double>, std::pair<double, double>>> init(std::string RobotID) {
-    std::lock_guard<std::mutex> guard(globalMutex);
-    int Robot_ID = server_ptr->startIndexToRobotID[RobotID];
+    int Robot_ID = server_ptr->startIndexToRobotID.at(RobotID);
+    RobotLock lock = server_ptr->lockRobot(Robot_ID);
 #ifdef DEBUG
     std::cerr << "TMP::Receive init request from agent " << RobotID << " with: " << Robot_ID << std::endl;
     if (Robot_ID == DEBUG_AGENT) {
@@ -141,7 +523,25 @@ std::vector<std::tuple<std::string, int, double, std::string, std::pair<double,
     }
 #endif
     startTimers[Robot_ID] = std::chrono::steady_clock::now();
-    return server_ptr->adg->getPlan(Robot_ID);
+    return server_ptr->getPlan(Robot_ID);
+}
+
+MACRO_PLAN init_macro(std::string RobotID) {
+    int Robot_ID = server_ptr->startIndexToRobotID.at(RobotID);
+    RobotLock lock = server_ptr->lockRobot(Robot_ID);
+    startTimers[Robot_ID] = std::chrono::steady_clock::now();
+    return server_ptr->getMacroPlan(Robot_ID);
+}
+
+double get_eta(std::string RobotID) {
+    int Robot_ID = server_ptr->startIndexToRobotID.at(RobotID);
+    RobotLock lock = server_ptr->lockRobot(Robot_ID);
+    return server_ptr->estimatedFinishTime(Robot_ID);
+}
+
+int extend_plans(std::map<std::string, std::string> segments) {
+    auto lock = server_ptr->lockAll();
+    return server_ptr->extendPlans(segments);
 }
 
 std::string getScenConfigName()
@@ -152,39 +552,79 @@ std::string getScenConfigName()
 
 
 std::vector<std::tuple<std::string, int, double, std::string, std::pair<double, double>, std::pair<double, double>>> update(std::string RobotID) {
-    std::lock_guard<std::mutex> guard(globalMutex);
-
-
-    int Robot_ID = server_ptr->startIndexToRobotID[RobotID];
+    int Robot_ID = server_ptr->startIndexToRobotID.at(RobotID);
+    RobotLock lock = server_ptr->lockRobot(Robot_ID);
     // if (server_ptr->step_cnt % 20 == 0 and Robot_ID == 0) {
-    //     server_ptr->adg->printProgress();
+    //     server_ptr->execution->printProgress();
     // }
     server_ptr->step_cnt++;
 #ifdef DEBUG
     if (Robot_ID == DEBUG_AGENT)
         std::cerr << "Receive update request from agent " << Robot_ID << std::endl;
 #endif
-    return server_ptr->adg->getPlan(Robot_ID);
+    return server_ptr->getPlan(Robot_ID);
 }
 
-void updateSimFinishTime(std::string& robot_id_str, int sim_step)
+// update_finish_agent for a robot whose lock is held.
+void recordSimFinishTime(int robot_id, int sim_step)
 {
-    int robot_id = server_ptr->startIndexToRobotID[robot_id_str];
     if (server_ptr->agent_finish_sim_step[robot_id] < 0) {
         server_ptr->agent_finish_sim_step[robot_id] = sim_step;
-        server_ptr->latest_arr_sim_step = sim_step;
+        // Robots report concurrently and out of order, keep the maximum.
+        int latest = server_ptr->latest_arr_sim_step.load();
+        while (latest < sim_step and not server_ptr->latest_arr_sim_step.compare_exchange_weak(latest, sim_step)) {
+        }
     }
 }
 
-void closeServer(rpc::server& srv)
+/*
+ * One tick of every robot in a single call: acks holds the last node each robot finished since its
+ * previous ack and the simulation step it finished at, requests the robots asking for new actions.
+ * The server is locked once for all of them. A robot finishing its plan gets that step as its finish
+ * step, so batched robots do not call update_finish_agent. Returns the receive_update reply of each
+ * acknowledging robot and the actions released to the requesting ones, each tagged with its robot name.
+ */
+STEP_RESULT step(std::vector<std::tuple<std::string, int, int>> acks, std::vector<std::string> requests) {
+    auto lock = server_ptr->lockAll();
+    STEP_RESULT result;
+    for (const auto& [robot_name, node_ID, sim_step]: acks) {
+        int Robot_ID = server_ptr->startIndexToRobotID.at(robot_name);
+        result.first[robot_name] = confirmNode(Robot_ID, node_ID);
+        if (server_ptr->agents_finish[Robot_ID]) {
+            recordSimFinishTime(Robot_ID, sim_step);
+        }
+    }
+    for (const auto& robot_name: requests) {
+        server_ptr->step_cnt++;
+        SIM_PLAN plan = server_ptr->getPlan(server_ptr->startIndexToRobotID.at(robot_name));
+        result.second.insert(result.second.end(), plan.begin(), plan.end());
+    }
+    return result;
+}
+
+MACRO_PLAN update_macro(std::string RobotID) {
+    int Robot_ID = server_ptr->startIndexToRobotID.at(RobotID);
+    RobotLock lock = server_ptr->lockRobot(Robot_ID);
+    server_ptr->step_cnt++;
+    return server_ptr->getMacroPlan(Robot_ID);
+}
+
+void updateSimFinishTime(std::string& robot_id_str, int sim_step)
 {
+    int robot_id = server_ptr->startIndexToRobotID.at(robot_id_str);
+    RobotLock lock = server_ptr->lockRobot(robot_id);
+    recordSimFinishTime(robot_id, sim_step);
+}
+
+void closeServer()
+{
+    auto lock = server_ptr->lockAll();
     // if (server_ptr->all_agents_finished) {
     //     std::cout << "Finish all actions, exiting..." << std::endl;
     // } else {
     //     std::cout << "BUG::exiting without finish all actions" << std::endl;
     // }
     server_ptr->saveStats();
-    srv.stop();
 }
 
 int main(int argc, char **argv) {
@@ -203,6 +643,23 @@ int main(int argc, char **argv) {
             ("scen_file,s", po::value<string>()->default_value("empty-8-8-random-1"), "scen filename")
             ("method_name", po::value<string>()->default_value("PBS"), "method we used")
             ("sim_dt", po::value<double>()->default_value(0.1), "simulation dt in seconds")
+            ("adg_threads", po::value<int>()->default_value(1), "number of threads used to build the ADG")
+            ("reduce_edges", po::value<bool>()->default_value(false), "remove type-2 edges implied by other edges")
+            ("prune_turn_edges", po::value<bool>()->default_value(false), "remove type-2 edges of turns implied by an edge of the adjacent move")
+            ("adg_cache", po::value<string>()->default_value(""), "directory for cached ADG snapshots, empty to disable")
+            ("adg_window", po::value<double>()->default_value(0.0), "only materialize the ADG this far ahead of the slowest agent, in plan time, 0 for all at once")
+            ("compact_interval", po::value<int>()->default_value(0), "drop finished ADG nodes whenever this many piled up, 0 to keep them")
+            ("cycle_check", po::value<string>()->default_value("reject"), "on a cyclic ADG: off, reject (exit) or repair (remove edges inside cycles)")
+            ("engine", po::value<string>()->default_value("adg"), "execution engine: adg (type-2 edges) or visit_queues (per point visit order, no edges)")
+            ("switch_edges", po::value<bool>()->default_value(false), "let a blocked agent pass a point first when the agent it waits for has not entered it yet")
+            ("move_seconds", po::value<double>()->default_value(1.0), "estimated seconds for a one cell move, for the critical path and ETAs")
+            ("turn_duration", po::value<double>()->default_value(1.0), "estimated time of a 90 degree turn, relative to a one cell move, for the critical path")
+            ("critical_priority", po::value<bool>()->default_value(false), "only switch edges in favour of the agent with less slack on the critical path")
+            ("eta", po::value<bool>()->default_value(false), "keep finish time estimates of all agents up to date, served by the get_eta RPC")
+            ("move_splits", po::value<int>()->default_value(2), "number of ADG nodes (sub-actions) every one cell move is split into")
+            ("reverse_moves", po::value<bool>()->default_value(false), "drive backwards out of a cell instead of turning around first")
+            ("platoon_gap", po::value<double>()->default_value(0.0), "release a robot following another one in the same direction once the leader is released this many cells ahead, 0 to wait for confirmations")
+            ("rpc_workers", po::value<int>()->default_value(1), "number of threads serving RPCs")
             ;
 
     po::variables_map vm;
@@ -220,8 +677,57 @@ int main(int argc, char **argv) {
     }
     // std::cout << "Solving for path name: " << filename << std::endl;
     std::string out_filename = vm["output_file"].as<string>();
+    ADGOptions adg_options;
+    adg_options.num_threads = vm["adg_threads"].as<int>();
+    adg_options.reduce_type2_edges = vm["reduce_edges"].as<bool>();
+    adg_options.prune_turn_edges = vm["prune_turn_edges"].as<bool>();
+    if (vm["platoon_gap"].as<double>() < 0.0) {
+        std::cerr << "platoon_gap must not be negative, exiting ..." << std::endl;
+        exit(-1);
+    }
+    int rpc_workers = vm["rpc_workers"].as<int>();
+    if (rpc_workers < 1) {
+        std::cerr << "rpc_workers must be at least 1, exiting ..." << std::endl;
+        exit(-1);
+    }
+    adg_options.move_splits = vm["move_splits"].as<int>();
+    if (adg_options.move_splits < 1) {
+        std::cerr << "move_splits must be at least 1, exiting ..." << std::endl;
+        exit(-1);
+    }
+    std::string cycle_check = vm["cycle_check"].as<string>();
+    if (cycle_check == "off") {
+        adg_options.cycle_check = CycleCheck::OFF;
+    } else if (cycle_check == "reject") {
+        adg_options.cycle_check = CycleCheck::REJECT;
+    } else if (cycle_check == "repair") {
+        adg_options.cycle_check = CycleCheck::REPAIR;
+    } else {
+        std::cerr << "Unknown cycle_check " << cycle_check << ", expected off, reject or repair" << std::endl;
+        exit(-1);
+    }
+    std::string engine = vm["engine"].as<string>();
+    if (engine == "visit_queues") {
+        adg_options.type2_edges = false;
+        if (vm["switch_edges"].as<bool>() or vm["critical_priority"].as<bool>() or vm["eta"].as<bool>() or
+            vm["adg_window"].as<double>() > 0.0 or vm["compact_interval"].as<int>() > 0 or
+            vm["platoon_gap"].as<double>() > 0.0) {
+            std::cerr << "The visit_queues engine supports none of switch_edges, critical_priority, eta, adg_window, "
+                         "compact_interval and platoon_gap, exiting ..." << std::endl;
+            exit(-1);
+        }
+    } else if (engine != "adg") {
+        std::cerr << "Unknown engine " << engine << ", expected adg or visit_queues" << std::endl;
+        exit(-1);
+    }
+    DurationModel durations;
+    durations.move = vm["move_seconds"].as<double>();
+    durations.quarter_turn = vm["turn_duration"].as<double>() * durations.move;
     server_ptr = std::make_shared<ADG_Server>(filename, out_filename, vm["map_file"].as<string>(), 
-        vm["scen_file"].as<string>(), vm["method_name"].as<string>(), vm["flip_coord"].as<bool>(), vm["sim_dt"].as<double>());
+        vm["scen_file"].as<string>(), vm["method_name"].as<string>(), vm["flip_coord"].as<bool>(), vm["sim_dt"].as<double>(),
+        adg_options, vm["adg_cache"].as<string>(), vm["adg_window"].as<double>(), vm["compact_interval"].as<int>(),
+        vm["switch_edges"].as<bool>(), durations, vm["critical_priority"].as<bool>(),
+        vm["eta"].as<bool>(), vm["reverse_moves"].as<bool>(), vm["platoon_gap"].as<double>(), rpc_workers);
 
     int port_number = vm["port_number"].as<int>();
     try {
@@ -229,12 +735,25 @@ int main(int argc, char **argv) {
         srv.bind("receive_update", &receive_update);  // Bind the function to the server
         srv.bind("init", &init);
         srv.bind("update", &update);
+        srv.bind("init_macro", &init_macro);
+        srv.bind("update_macro", &update_macro);
+        srv.bind("step", &step);
         srv.bind("get_config", &getScenConfigName);
         srv.bind("update_finish_agent", &updateSimFinishTime);
-        srv.bind("closeServer", [&srv]() {
-            closeServer(srv);
+        srv.bind("extend_plans", &extend_plans);
+        srv.bind("get_eta", &get_eta);
+        // The workers cannot stop the server they run on, so the main thread does once stats are saved.
+        std::promise<void> closed;
+        std::once_flag close_once;
+        srv.bind("closeServer", [&closed, &close_once]() {
+            std::call_once(close_once, [&closed]() {
+                closeServer();
+                closed.set_value();
+            });
         });
-        srv.run();  // Start the server, blocking call
+        srv.async_run(rpc_workers);
+        closed.get_future().wait();
+        srv.stop();
     } catch (...) {
         // Catch any other exceptions
         std::cerr << "Fail to starting the server for scen "<< vm["scen_file"].as<string>() << " at port number: " << port_number << std::endl;
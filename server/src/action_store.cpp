@@ -0,0 +1,299 @@
+#include "action_store.h"
+
+#include <algorithm>
+#include <numeric>
+#include <tuple>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+int16_t ActionStore::toUnits(double coord) const {
+    long units = std::lround(coord * cell_units);
+    if (units < INT16_MIN or units > INT16_MAX) {
+        std::cerr << "Coordinate " << coord << " does not fit the action store at " << cell_units <<
+            " units per cell, exiting ..." << std::endl;
+        exit(-1);
+    }
+    return static_cast<int16_t>(units);
+}
+
+bool ActionStore::fits(const Action& action) const {
+    for (double coord: {action.start.first, action.start.second, action.goal.first, action.goal.second}) {
+        long units = std::lround(coord * cell_units);
+        if (units < INT16_MIN or units > INT16_MAX) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ActionStore::build(const std::vector<std::vector<Action>>& plans, int units) {
+    cell_units = units;
+    node_offset.assign(plans.size() + 1, 0);
+    first_node.assign(plans.size(), 0);
+    for (size_t i = 0; i < plans.size(); i++) {
+        node_offset[i+1] = node_offset[i] + static_cast<int>(plans[i].size());
+    }
+    int total = node_offset.back();
+    agent_id.resize(total);
+    start_x.resize(total);
+    start_y.resize(total);
+    goal_x.resize(total);
+    goal_y.resize(total);
+    time.resize(total);
+    type.resize(total);
+    flags.resize(total);
+    for (size_t i = 0; i < plans.size(); i++) {
+        for (size_t j = 0; j < plans[i].size(); j++) {
+            set(node_offset[i] + static_cast<int>(j), static_cast<int>(i), plans[i][j]);
+        }
+    }
+}
+
+void ActionStore::set(int idx, int agent, const Action& action) {
+    agent_id[idx] = static_cast<int32_t>(agent);
+    start_x[idx] = toUnits(action.start.first);
+    start_y[idx] = toUnits(action.start.second);
+    goal_x[idx] = toUnits(action.goal.first);
+    goal_y[idx] = toUnits(action.goal.second);
+    time[idx] = action.time;
+    type[idx] = action.type;
+    flags[idx] = (static_cast<uint8_t>(static_cast<int>(action.orientation)) & ORIENTATION_MASK) |
+                 (action.reverse ? REVERSE_FLAG : 0);
+}
+
+// Moves the per-agent ranges of one array to their new offsets, dropping the first skip[i] values
+// of agent i and leaving room for appended actions.
+template <typename T>
+static void moveAgentRanges(std::vector<T>& values, const std::vector<int>& old_offset, const std::vector<int>& skip,
+                            const std::vector<int>& new_offset) {
+    std::vector<T> moved(new_offset.back());
+    for (size_t i = 0; i + 1 < old_offset.size(); i++) {
+        std::copy(values.begin() + old_offset[i] + skip[i], values.begin() + old_offset[i+1], moved.begin() + new_offset[i]);
+    }
+    values.swap(moved);
+}
+
+static void moveActions(ActionStore& store, const std::vector<int>& old_offset, const std::vector<int>& skip) {
+    moveAgentRanges(store.agent_id, old_offset, skip, store.node_offset);
+    moveAgentRanges(store.start_x, old_offset, skip, store.node_offset);
+    moveAgentRanges(store.start_y, old_offset, skip, store.node_offset);
+    moveAgentRanges(store.goal_x, old_offset, skip, store.node_offset);
+    moveAgentRanges(store.goal_y, old_offset, skip, store.node_offset);
+    moveAgentRanges(store.time, old_offset, skip, store.node_offset);
+    moveAgentRanges(store.type, old_offset, skip, store.node_offset);
+    moveAgentRanges(store.flags, old_offset, skip, store.node_offset);
+}
+
+void ActionStore::append(const std::vector<std::vector<Action>>& segments) {
+    std::vector<int> old_offset = node_offset;
+    for (size_t i = 0; i < segments.size(); i++) {
+        node_offset[i+1] = node_offset[i] + (old_offset[i+1] - old_offset[i]) + static_cast<int>(segments[i].size());
+    }
+    moveActions(*this, old_offset, std::vector<int>(segments.size(), 0));
+    for (size_t i = 0; i < segments.size(); i++) {
+        int first = node_offset[i] + old_offset[i+1] - old_offset[i];
+        for (size_t j = 0; j < segments[i].size(); j++) {
+            set(first + static_cast<int>(j), static_cast<int>(i), segments[i][j]);
+        }
+    }
+}
+
+void ActionStore::dropBefore(const std::vector<int>& first_kept) {
+    std::vector<int> old_offset = node_offset;
+    std::vector<int> skip(first_kept.size(), 0);
+    for (size_t i = 0; i < first_kept.size(); i++) {
+        skip[i] = std::max(0, first_kept[i] - first_node[i]);
+        first_node[i] += skip[i];
+        node_offset[i+1] = node_offset[i] + (old_offset[i+1] - old_offset[i]) - skip[i];
+    }
+    moveActions(*this, old_offset, skip);
+}
+
+Action ActionStore::action(int idx) const {
+    Action action;
+    action.robot_id = agent_id[idx];
+    action.time = time[idx];
+    action.orientation = orientation(idx);
+    action.type = type[idx];
+    action.reverse = isReverse(idx);
+    action.start = startPoint(idx);
+    action.goal = goalPoint(idx);
+    action.nodeID = idx;
+    return action;
+}
+
+std::vector<std::vector<Action>> ActionStore::toPlans() const {
+    std::vector<std::vector<Action>> plans(node_offset.size() - 1);
+    for (int idx = 0; idx < size(); idx++) {
+        plans[agent_id[idx]].push_back(action(idx));
+    }
+    return plans;
+}
+
+void ActionStore::writeSnapshot(SnapshotWriter& writer) const {
+    writer.value(cell_units);
+    writer.array(node_offset);
+    writer.array(first_node);
+    writer.array(agent_id);
+    writer.array(start_x);
+    writer.array(start_y);
+    writer.array(goal_x);
+    writer.array(goal_y);
+    writer.array(time);
+    writer.array(type);
+    writer.array(flags);
+}
+
+bool ActionStore::readSnapshot(SnapshotReader& reader) {
+    if (not (reader.value(cell_units) and reader.array(node_offset) and reader.array(first_node) and reader.array(agent_id) and reader.array(start_x) and
+             reader.array(start_y) and reader.array(goal_x) and reader.array(goal_y) and reader.array(time) and
+             reader.array(type) and reader.array(flags))) {
+        return false;
+    }
+    size_t total = agent_id.size();
+    if (node_offset.empty() or node_offset.front() != 0 or node_offset.back() != static_cast<int>(total) or
+        first_node.size() + 1 != node_offset.size() or cell_units < 1 or
+        start_x.size() != total or start_y.size() != total or goal_x.size() != total or
+        goal_y.size() != total or time.size() != total or type.size() != total or flags.size() != total) {
+        return false;
+    }
+    for (size_t agent = 0; agent < first_node.size(); agent++) {
+        // Snapshots hold complete plans, and robots are named after their first action.
+        if (node_offset[agent] >= node_offset[agent + 1] or first_node[agent] != 0) {
+            return false;
+        }
+    }
+    // index() and nodeOf() rely on every agent owning exactly the actions between its offsets.
+    for (size_t agent = 0; agent < first_node.size(); agent++) {
+        for (int idx = node_offset[agent]; idx < node_offset[agent + 1]; idx++) {
+            if (agent_id[idx] != static_cast<int32_t>(agent)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void CellIndex::build(const ActionStore& actions) {
+    std::vector<int> all(actions.size());
+    std::iota(all.begin(), all.end(), 0);
+    build(actions, std::move(all));
+}
+
+void CellIndex::build(const ActionStore& actions, std::vector<int> subset) {
+    int total = static_cast<int>(subset.size());
+    leaving = subset;
+    entering = std::move(subset);
+    // Action indices grow with (agent, node), which keeps ties in the pairwise scan order.
+    std::sort(leaving.begin(), leaving.end(), [&actions](int a, int b) {
+        return std::make_tuple(actions.startCell(a), actions.time[a], a) <
+               std::make_tuple(actions.startCell(b), actions.time[b], b);
+    });
+    std::sort(entering.begin(), entering.end(), [&actions](int a, int b) {
+        return std::make_tuple(actions.goalCell(a), actions.time[a], a) <
+               std::make_tuple(actions.goalCell(b), actions.time[b], b);
+    });
+
+    enter_agent.resize(total);
+    enter_start_x.resize(total);
+    enter_start_y.resize(total);
+    enter_time.resize(total);
+    for (int p = 0; p < total; p++) {
+        int idx = entering[p];
+        enter_agent[p] = actions.agent_id[idx];
+        enter_start_x[p] = actions.start_x[idx];
+        enter_start_y[p] = actions.start_y[idx];
+        enter_time[p] = actions.time[idx];
+    }
+
+    cells.clear();
+    int l = 0, e = 0;
+    while (l < total and e < total) {
+        uint64_t leave_code = actions.startCell(leaving[l]);
+        uint64_t enter_code = actions.goalCell(entering[e]);
+        if (leave_code < enter_code) {
+            while (l < total and actions.startCell(leaving[l]) == leave_code) l++;
+        } else if (enter_code < leave_code) {
+            while (e < total and actions.goalCell(entering[e]) == enter_code) e++;
+        } else {
+            Cell cell {leave_code, l, l, e, e};
+            while (cell.leave_end < total and actions.startCell(leaving[cell.leave_end]) == leave_code) cell.leave_end++;
+            while (cell.enter_end < total and actions.goalCell(entering[cell.enter_end]) == enter_code) cell.enter_end++;
+            l = cell.leave_end;
+            e = cell.enter_end;
+            cells.push_back(cell);
+        }
+    }
+}
+
+int matchEnteringActionsScalar(const int32_t* agent, const int32_t* start_x, const int32_t* start_y,
+                               int begin, int tie_end, int end,
+                               int32_t leave_agent, int32_t goal_x, int32_t goal_y, int* out) {
+    int cnt = 0;
+    for (int p = begin; p < end; p++) {
+        if (agent[p] == leave_agent) {
+            continue;
+        }
+        if (p < tie_end and agent[p] < leave_agent and start_x[p] == goal_x and start_y[p] == goal_y) {
+            continue;
+        }
+        out[cnt++] = p;
+    }
+    return cnt;
+}
+
+int matchEnteringActions(const int32_t* agent, const int32_t* start_x, const int32_t* start_y,
+                         int begin, int tie_end, int end,
+                         int32_t leave_agent, int32_t goal_x, int32_t goal_y, int* out) {
+    int cnt = 0;
+    int p = begin;
+#if defined(__AVX2__)
+    const __m256i v_agent = _mm256_set1_epi32(leave_agent);
+    const __m256i v_goal_x = _mm256_set1_epi32(goal_x);
+    const __m256i v_goal_y = _mm256_set1_epi32(goal_y);
+    const __m256i v_tie_end = _mm256_set1_epi32(tie_end);
+    const __m256i v_lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    for (; p + 8 <= end; p += 8) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(agent + p));
+        __m256i sx = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(start_x + p));
+        __m256i sy = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(start_y + p));
+        __m256i pos = _mm256_add_epi32(_mm256_set1_epi32(p), v_lane);
+        __m256i same_agent = _mm256_cmpeq_epi32(a, v_agent);
+        __m256i swap = _mm256_and_si256(
+            _mm256_and_si256(_mm256_cmpgt_epi32(v_agent, a), _mm256_cmpgt_epi32(v_tie_end, pos)),
+            _mm256_and_si256(_mm256_cmpeq_epi32(sx, v_goal_x), _mm256_cmpeq_epi32(sy, v_goal_y)));
+        int skip = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_or_si256(same_agent, swap)));
+        unsigned keep = ~static_cast<unsigned>(skip) & 0xFFu;
+        while (keep) {
+            out[cnt++] = p + __builtin_ctz(keep);
+            keep &= keep - 1;
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i v_agent = _mm_set1_epi32(leave_agent);
+    const __m128i v_goal_x = _mm_set1_epi32(goal_x);
+    const __m128i v_goal_y = _mm_set1_epi32(goal_y);
+    const __m128i v_tie_end = _mm_set1_epi32(tie_end);
+    const __m128i v_lane = _mm_setr_epi32(0, 1, 2, 3);
+    for (; p + 4 <= end; p += 4) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(agent + p));
+        __m128i sx = _mm_loadu_si128(reinterpret_cast<const __m128i*>(start_x + p));
+        __m128i sy = _mm_loadu_si128(reinterpret_cast<const __m128i*>(start_y + p));
+        __m128i pos = _mm_add_epi32(_mm_set1_epi32(p), v_lane);
+        __m128i same_agent = _mm_cmpeq_epi32(a, v_agent);
+        __m128i swap = _mm_and_si128(
+            _mm_and_si128(_mm_cmpgt_epi32(v_agent, a), _mm_cmpgt_epi32(v_tie_end, pos)),
+            _mm_and_si128(_mm_cmpeq_epi32(sx, v_goal_x), _mm_cmpeq_epi32(sy, v_goal_y)));
+        int skip = _mm_movemask_ps(_mm_castsi128_ps(_mm_or_si128(same_agent, swap)));
+        unsigned keep = ~static_cast<unsigned>(skip) & 0xFu;
+        while (keep) {
+            out[cnt++] = p + __builtin_ctz(keep);
+            keep &= keep - 1;
+        }
+    }
+#endif
+    cnt += matchEnteringActionsScalar(agent, start_x, start_y, p, tie_end, end, leave_agent, goal_x, goal_y, out + cnt);
+    return cnt;
+}
@@ -0,0 +1,203 @@
+#include "ADG.h"
+
+// Successors of node v: the next action of the same agent, then the targets of the type-2 out-edges.
+template <typename Visit>
+static void forEachSuccessor(const ActionStore& actions, const EdgeStore& edges, int v, Visit visit) {
+    int agent = actions.agent_id[v];
+    if (v + 1 < actions.node_offset[agent+1]) {
+        visit(v + 1);
+    }
+    for (int e = edges.outBegin(v); e < edges.outEnd(v); e++) {
+        visit(edges.target(e));
+    }
+}
+
+/*
+ * Nodes on no cycle are peeled first, Kahn style: a node whose predecessors are all peeled is peeled
+ * itself. Each round processes the current frontier, split across num_threads workers when it is
+ * large, with atomic in-degree counters. Whatever remains lies on a cycle or after one, and Tarjan's
+ * algorithm, run iteratively on that residue only, separates the cycles from the rest.
+ */
+std::vector<std::vector<int>> ADG::findCycles(int num_threads) const {
+    static constexpr size_t PARALLEL_FRONTIER = 4096;
+    int total = action_store.size();
+    std::unique_ptr<std::atomic<int>[]> in_degree(new std::atomic<int>[total]);
+    std::vector<int> frontier;
+    for (int v = 0; v < total; v++) {
+        int agent = action_store.agent_id[v];
+        int degree = edge_store.inEnd(v) - edge_store.inBegin(v) + (v > action_store.node_offset[agent] ? 1 : 0);
+        in_degree[v].store(degree, std::memory_order_relaxed);
+        if (degree == 0) {
+            frontier.push_back(v);
+        }
+    }
+
+    std::vector<char> peeled(total, 0);
+    auto peel = [&](const int* begin, const int* end, std::vector<int>& next) {
+        for (const int* v = begin; v < end; v++) {
+            peeled[*v] = 1;
+            forEachSuccessor(action_store, edge_store, *v, [&](int w) {
+                if (in_degree[w].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    next.push_back(w);
+                }
+            });
+        }
+    };
+    num_threads = std::max(1, num_threads);
+    std::vector<std::vector<int>> thread_next(num_threads);
+    while (not frontier.empty()) {
+        std::vector<int> next;
+        if (num_threads == 1 or frontier.size() < PARALLEL_FRONTIER) {
+            peel(frontier.data(), frontier.data() + frontier.size(), next);
+        } else {
+            std::vector<std::thread> workers;
+            size_t chunk = (frontier.size() + num_threads - 1) / num_threads;
+            for (int t = 0; t < num_threads; t++) {
+                size_t begin = std::min(frontier.size(), t * chunk);
+                size_t end = std::min(frontier.size(), begin + chunk);
+                thread_next[t].clear();
+                workers.emplace_back(peel, frontier.data() + begin, frontier.data() + end, std::ref(thread_next[t]));
+            }
+            for (auto& worker: workers) {
+                worker.join();
+            }
+            for (const auto& part: thread_next) {
+                next.insert(next.end(), part.begin(), part.end());
+            }
+        }
+        frontier.swap(next);
+    }
+
+    std::vector<std::vector<int>> components;
+    std::vector<int> order(total, -1), low_link(total, 0);
+    std::vector<char> on_stack(total, 0);
+    std::vector<int> scc_stack;
+    // Call stack of (node, next successor slot); slot 0 is the type-1 successor, slot k > 0 the k-th out-edge.
+    std::vector<std::pair<int, int>> call_stack;
+    int counter = 0;
+    auto successor = [this](int v, int slot) {
+        if (slot == 0) {
+            int agent = action_store.agent_id[v];
+            return v + 1 < action_store.node_offset[agent+1] ? v + 1 : -1;
+        }
+        return edge_store.target(edge_store.outBegin(v) + slot - 1);
+    };
+    for (int root = 0; root < total; root++) {
+        if (peeled[root] or order[root] >= 0) {
+            continue;
+        }
+        call_stack.emplace_back(root, 0);
+        order[root] = low_link[root] = counter++;
+        scc_stack.push_back(root);
+        on_stack[root] = 1;
+        while (not call_stack.empty()) {
+            auto& [v, slot] = call_stack.back();
+            int num_slots = 1 + edge_store.outEnd(v) - edge_store.outBegin(v);
+            if (slot < num_slots) {
+                int w = successor(v, slot++);
+                if (w < 0 or peeled[w]) {
+                    continue;
+                }
+                if (order[w] < 0) {
+                    order[w] = low_link[w] = counter++;
+                    scc_stack.push_back(w);
+                    on_stack[w] = 1;
+                    call_stack.emplace_back(w, 0);
+                } else if (on_stack[w]) {
+                    low_link[v] = std::min(low_link[v], order[w]);
+                }
+                continue;
+            }
+            int finished = v;
+            call_stack.pop_back();
+            if (not call_stack.empty()) {
+                int parent = call_stack.back().first;
+                low_link[parent] = std::min(low_link[parent], low_link[finished]);
+            }
+            if (low_link[finished] == order[finished]) {
+                std::vector<int> component;
+                int w;
+                do {
+                    w = scc_stack.back();
+                    scc_stack.pop_back();
+                    on_stack[w] = 0;
+                    component.push_back(w);
+                } while (w != finished);
+                if (component.size() > 1) {
+                    std::sort(component.begin(), component.end());
+                    components.push_back(std::move(component));
+                }
+            }
+        }
+    }
+    return components;
+}
+
+/*
+ * Every cycle needs a type-2 edge inside a component. Removing those between actions that start at
+ * the same time, the ambiguous ones, usually suffices. Otherwise, once every edge from a larger to a
+ * smaller agent inside a component is gone, type-2 edges only lead to larger agents and type-1
+ * edges stay within one, so no cycle is left.
+ */
+std::shared_ptr<ADG> ADG::breakCycles(const std::vector<std::vector<int>>& components, bool ties_only,
+                                      int& removed) const {
+    std::vector<int> component_of(action_store.size(), -1);
+    for (size_t c = 0; c < components.size(); c++) {
+        for (int v: components[c]) {
+            component_of[v] = static_cast<int>(c);
+        }
+    }
+    std::vector<std::pair<int, int>> edge_nodes;
+    std::vector<Type2EdgeRecord> kept;
+    edge_nodes.reserve(edge_store.numEdges());
+    kept.reserve(edge_store.numEdges());
+    removed = 0;
+    for (int v = 0; v < action_store.size(); v++) {
+        for (int e = edge_store.outBegin(v); e < edge_store.outEnd(v); e++) {
+            int w = edge_store.target(e);
+            bool inside = component_of[v] >= 0 and component_of[v] == component_of[w];
+            bool drop = ties_only ? action_store.time[v] == action_store.time[w]
+                                  : action_store.agent_id[v] > action_store.agent_id[w];
+            if (inside and drop) {
+                removed++;
+            } else {
+                edge_nodes.emplace_back(v, w);
+                kept.push_back({action_store.agent_id[v], action_store.nodeOf(v), action_store.agent_id[w],
+                                action_store.nodeOf(w)});
+            }
+        }
+    }
+    std::shared_ptr<ADG> next(new ADG(*this));
+    next->edge_store.build(action_store.size(), edge_nodes);
+    // The removed edges are gone for good, so the stats count them neither as built nor as kept, and a
+    // pair of agents whose every shared edge was removed no longer conflicts.
+    next->adg_stats.type2EdgeCount -= removed;
+    next->adg_stats.reducedType2EdgeCount -= removed;
+    next->adg_stats.conflict_pairs.clear();
+    next->addConflictPairs(kept);
+    return next;
+}
+
+void ADG::printCycles(const std::vector<std::vector<int>>& components) const {
+    static constexpr size_t MAX_PRINTED_NODES = 20;
+    for (const auto& component: components) {
+        std::vector<int> agents;
+        for (int v: component) {
+            agents.push_back(action_store.agent_id[v]);
+        }
+        agents.erase(std::unique(agents.begin(), agents.end()), agents.end());
+        std::cerr << "Cycle over " << component.size() << " nodes of agents";
+        for (int agent: agents) {
+            std::cerr << " " << agent << " (" << robotIDToStartIndex.at(agent) << ")";
+        }
+        std::cerr << "; nodes";
+        for (size_t k = 0; k < component.size() and k < MAX_PRINTED_NODES; k++) {
+            int v = component[k];
+            std::cerr << " " << action_store.agent_id[v] << ":" << action_store.nodeOf(v);
+        }
+        if (component.size() > MAX_PRINTED_NODES) {
+            std::cerr << " ...";
+        }
+        std::cerr << std::endl;
+    }
+}
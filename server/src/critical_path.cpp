@@ -0,0 +1,105 @@
+#include "critical_path.h"
+#include "execution_state.h"
+
+double DurationModel::duration(const ActionStore& actions, int idx) const {
+    if (actions.start_x[idx] != actions.goal_x[idx] or actions.start_y[idx] != actions.goal_y[idx]) {
+        double dx = (actions.goal_x[idx] - actions.start_x[idx]) / static_cast<double>(actions.cell_units);
+        double dy = (actions.goal_y[idx] - actions.start_y[idx]) / static_cast<double>(actions.cell_units);
+        return move * std::sqrt(dx * dx + dy * dy);
+    }
+    // A turn whose previous action was dropped by compaction counts as one quarter turn.
+    int quarter_turns = 1;
+    int agent = actions.agent_id[idx];
+    if (idx > actions.node_offset[agent]) {
+        int turned = (actions.orientation(idx) - actions.orientation(idx - 1) + 4) % 4;
+        quarter_turns = std::min(turned, 4 - turned);
+    }
+    return quarter_turn * quarter_turns;
+}
+
+void CriticalPath::refresh(const ExecutionState& execution) {
+    if (graph_changed or (finished_since_update > 0 and finished_since_update >= refresh_interval)) {
+        update(execution);
+    }
+}
+
+/*
+ * Kahn's order over the unfinished nodes: a node is ready once its type-1 predecessor and every node
+ * it still waits on are processed. Earliest starts propagate forward along that order and latest
+ * starts backward along its reverse. Nodes left out by a cycle keep zero slack.
+ */
+void CriticalPath::update(const ExecutionState& execution) {
+    const ADG& adg = execution.graph();
+    const ActionStore& actions = adg.actions();
+    int total = adg.numNodes();
+    std::vector<int> in_degree(total, 0);
+    std::vector<double> node_duration(total, 0.0);
+    std::vector<int> order;
+    order.reserve(total);
+    earliest_start.assign(total, 0.0);
+    slack_time.assign(total, INF);
+    for (int i = 0; i < adg.numRobots(); i++) {
+        int first = actions.index(i, execution.finished_node_idx[i] + 1);
+        for (int v = first; v < actions.node_offset[i+1]; v++) {
+            in_degree[v] = execution.remainingDeps(v) + (v > first ? 1 : 0);
+            node_duration[v] = model.duration(actions, v);
+            slack_time[v] = 0.0;
+            if (in_degree[v] == 0) {
+                order.push_back(v);
+            }
+        }
+    }
+
+    path_length = 0.0;
+    for (size_t k = 0; k < order.size(); k++) {
+        int v = order[k];
+        double finish = earliest_start[v] + node_duration[v];
+        path_length = std::max(path_length, finish);
+        execution.forEachSuccessor(v, [&](int w) {
+            earliest_start[w] = std::max(earliest_start[w], finish);
+            if (--in_degree[w] == 0) {
+                order.push_back(w);
+            }
+        });
+    }
+
+    std::vector<double> latest_start(total, INF);
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        int v = *it;
+        double latest_finish = path_length;
+        execution.forEachSuccessor(v, [&](int w) {
+            latest_finish = std::min(latest_finish, latest_start[w]);
+        });
+        latest_start[v] = latest_finish - node_duration[v];
+        slack_time[v] = std::max(0.0, latest_start[v] - earliest_start[v]);
+    }
+    finished_since_update = 0;
+    graph_changed = false;
+}
+
+double CriticalPath::slack(const ExecutionState& execution, int idx) {
+    refresh(execution);
+    return slack_time[idx];
+}
+
+double CriticalPath::length(const ExecutionState& execution) {
+    refresh(execution);
+    return path_length;
+}
+
+std::vector<int> CriticalPath::criticalAgents(const ExecutionState& execution) {
+    static constexpr double EPSILON = 1e-9;
+    refresh(execution);
+    const ActionStore& actions = execution.graph().actions();
+    std::vector<int> agents;
+    for (int i = 0; i < execution.graph().numRobots(); i++) {
+        int first = actions.index(i, execution.finished_node_idx[i] + 1);
+        for (int v = first; v < actions.node_offset[i+1]; v++) {
+            if (slack_time[v] <= EPSILON * std::max(1.0, path_length)) {
+                agents.push_back(i);
+                break;
+            }
+        }
+    }
+    return agents;
+}
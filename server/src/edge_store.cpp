@@ -0,0 +1,81 @@
+#include "edge_store.h"
+
+void EdgeStore::build(int num_nodes, const std::vector<std::pair<int, int>>& edges) {
+    int num_edges = static_cast<int>(edges.size());
+    out_offset.assign(num_nodes + 1, 0);
+    in_offset.assign(num_nodes + 1, 0);
+    for (const auto& [from, to]: edges) {
+        out_offset[from + 1]++;
+        in_offset[to + 1]++;
+    }
+    for (int v = 0; v < num_nodes; v++) {
+        out_offset[v + 1] += out_offset[v];
+        in_offset[v + 1] += in_offset[v];
+    }
+
+    // Counting sort by source keeps the input order among edges of one node.
+    std::vector<int> edge_source(num_edges);
+    out_target.resize(num_edges);
+    std::vector<int> cursor(out_offset.begin(), out_offset.end() - 1);
+    for (const auto& [from, to]: edges) {
+        int e = cursor[from]++;
+        out_target[e] = to;
+        edge_source[e] = from;
+    }
+
+    // Walking edges in CSR order lists the incoming edges of each node by increasing source.
+    in_edge.resize(num_edges);
+    in_source.resize(num_edges);
+    cursor.assign(in_offset.begin(), in_offset.end() - 1);
+    for (int e = 0; e < num_edges; e++) {
+        int k = cursor[out_target[e]]++;
+        in_edge[k] = e;
+        in_source[k] = edge_source[e];
+    }
+}
+
+void EdgeStore::writeSnapshot(SnapshotWriter& writer) const {
+    writer.array(out_offset);
+    writer.array(out_target);
+    writer.array(in_offset);
+    writer.array(in_edge);
+    writer.array(in_source);
+}
+
+bool EdgeStore::readSnapshot(SnapshotReader& reader, int num_nodes) {
+    if (not (reader.array(out_offset) and reader.array(out_target) and reader.array(in_offset) and
+             reader.array(in_edge) and reader.array(in_source))) {
+        return false;
+    }
+    size_t num_edges = out_target.size();
+    if (out_offset.size() != static_cast<size_t>(num_nodes) + 1 or in_offset.size() != out_offset.size() or
+        out_offset.back() != static_cast<int>(num_edges) or in_offset.back() != static_cast<int>(num_edges) or
+        in_edge.size() != num_edges or in_source.size() != num_edges or out_offset.front() != 0 or
+        in_offset.front() != 0) {
+        return false;
+    }
+    for (int v = 0; v < num_nodes; v++) {
+        if (out_offset[v] > out_offset[v + 1] or in_offset[v] > in_offset[v + 1]) {
+            return false;
+        }
+    }
+    // Every incoming slot of node v has to name an edge into v from the source it lists.
+    std::vector<int> edge_source(num_edges);
+    for (int v = 0; v < num_nodes; v++) {
+        for (int e = out_offset[v]; e < out_offset[v + 1]; e++) {
+            if (out_target[e] < 0 or out_target[e] >= num_nodes) {
+                return false;
+            }
+            edge_source[e] = v;
+        }
+    }
+    for (int v = 0; v < num_nodes; v++) {
+        for (int k = in_offset[v]; k < in_offset[v + 1]; k++) {
+            int e = in_edge[k];
+            if (e < 0 or e >= static_cast<int>(num_edges) or out_target[e] != v or edge_source[e] != in_source[k]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
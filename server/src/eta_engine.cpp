@@ -0,0 +1,119 @@
+#include "eta_engine.h"
+#include "execution_state.h"
+
+void EtaEngine::reset(const ExecutionState& execution) {
+    int num_robots = execution.graph().numRobots();
+    finish_time.assign(execution.graph().numNodes(), 0.0);
+    agent_eta.assign(num_robots, 0.0);
+    last_report.assign(num_robots, 0.0);
+    updated_estimates = 0;
+    recompute(execution);
+}
+
+void EtaEngine::remap(const ActionStore& old_actions, const ActionStore& next_actions) {
+    std::vector<double> next_finish_time(next_actions.size(), 0.0);
+    for (size_t i = 0; i + 1 < next_actions.node_offset.size(); i++) {
+        int first = std::max(old_actions.first_node[i], next_actions.first_node[i]);
+        int end = std::min(old_actions.planSize(i), next_actions.planSize(i));
+        for (int node = first; node < end; node++) {
+            next_finish_time[next_actions.index(i, node)] = finish_time[old_actions.index(i, node)];
+        }
+    }
+    finish_time.swap(next_finish_time);
+}
+
+// Kahn's order over the unfinished nodes, as in CriticalPath::update, starting from the reports.
+void EtaEngine::recompute(const ExecutionState& execution) {
+    const ADG& adg = execution.graph();
+    const ActionStore& actions = adg.actions();
+    int total = adg.numNodes();
+    std::vector<int> in_degree(total, 0);
+    std::vector<double> start(total, 0.0);
+    std::vector<int> order;
+    order.reserve(total);
+    for (int i = 0; i < adg.numRobots(); i++) {
+        int first = actions.index(i, execution.finished_node_idx[i] + 1);
+        for (int v = first; v < actions.node_offset[i+1]; v++) {
+            in_degree[v] = execution.remainingDeps(v) + (v > first ? 1 : 0);
+            start[v] = last_report[i];
+            execution.forEachPredecessor(v, [&](int u) {
+                if (execution.isFinished(u)) {
+                    start[v] = std::max(start[v], finish_time[u]);
+                }
+            });
+            if (in_degree[v] == 0) {
+                order.push_back(v);
+            }
+        }
+    }
+    for (size_t k = 0; k < order.size(); k++) {
+        int v = order[k];
+        finish_time[v] = start[v] + model.duration(actions, v);
+        execution.forEachSuccessor(v, [&](int w) {
+            start[w] = std::max(start[w], finish_time[v]);
+            if (--in_degree[w] == 0) {
+                order.push_back(w);
+            }
+        });
+    }
+    for (int i = 0; i < adg.numRobots(); i++) {
+        if (actions.node_offset[i+1] > actions.node_offset[i]) {
+            agent_eta[i] = finish_time[actions.node_offset[i+1] - 1];
+        }
+    }
+    pending = {};
+    queued.assign(total, 0);
+}
+
+double EtaEngine::estimate(const ExecutionState& execution, int idx) const {
+    double start = last_report[execution.graph().actions().agent_id[idx]];
+    execution.forEachPredecessor(idx, [&](int u) {
+        start = std::max(start, finish_time[u]);
+    });
+    return start + model.duration(execution.graph().actions(), idx);
+}
+
+void EtaEngine::setFinishTime(const ExecutionState& execution, int idx, double time) {
+    const ActionStore& actions = execution.graph().actions();
+    finish_time[idx] = time;
+    int agent = actions.agent_id[idx];
+    if (idx == actions.node_offset[agent+1] - 1) {
+        agent_eta[agent] = time;
+    }
+}
+
+void EtaEngine::nodeFinished(const ExecutionState& execution, int idx, double now) {
+    last_report[execution.graph().actions().agent_id[idx]] = now;
+    setFinishTime(execution, idx, now);
+    execution.forEachSuccessor(idx, [&](int w) {
+        enqueue(now, w);
+    });
+    // Edges dropped before their source finished, by switching or platoon following, count it again now.
+    const EdgeStore& edges = execution.graph().edges();
+    for (int e = edges.outBegin(idx); e < edges.outEnd(idx); e++) {
+        if (not execution.isEdgeValid(e)) {
+            enqueue(now, edges.target(e));
+        }
+    }
+}
+
+void EtaEngine::propagate(const ExecutionState& execution) {
+    static constexpr double EPSILON = 1e-9;
+    while (not pending.empty()) {
+        int w = pending.top().second;
+        pending.pop();
+        queued[w] = 0;
+        if (execution.isFinished(w)) {
+            continue;
+        }
+        double next = estimate(execution, w);
+        if (std::abs(next - finish_time[w]) <= EPSILON) {
+            continue;
+        }
+        setFinishTime(execution, w, next);
+        updated_estimates++;
+        execution.forEachSuccessor(w, [&](int x) {
+            enqueue(next, x);
+        });
+    }
+}
@@ -0,0 +1,534 @@
+#include "execution_state.h"
+
+#include <unordered_set>
+
+ExecutionState::ExecutionState(std::shared_ptr<const ADG> adg): adg(std::move(adg)) {
+    reset();
+}
+
+void ExecutionState::reset() {
+    const EdgeStore& edge_store = adg->edges();
+    int num_robots = adg->numRobots();
+    finished_node_idx.assign(num_robots, -1);
+    enqueue_nodes_idx.assign(num_robots, {});
+    valid_bits = std::vector<std::atomic<uint64_t>>((edge_store.numEdges() + 63) / 64);
+    for (auto& bits: valid_bits) {
+        bits.store(~uint64_t(0), std::memory_order_relaxed);
+    }
+    remaining_deps = std::vector<std::atomic<int>>(adg->numNodes());
+    for (int v = 0; v < adg->numNodes(); v++) {
+        remaining_deps[v].store(edge_store.inEnd(v) - edge_store.inBegin(v), std::memory_order_relaxed);
+    }
+    ready_frontier.assign(num_robots, 0);
+    switch_tried.assign(num_robots, -1);
+    dynamic_out.clear();
+    dynamic_in.clear();
+    switched_orders.clear();
+    platoon_releases = 0;
+    if (critical_path != nullptr) {
+        critical_path->graphChanged();
+    }
+    if (eta_engine != nullptr) {
+        eta_engine->reset(*this);
+    }
+}
+
+void ExecutionState::enableCriticalPath(const DurationModel& model, bool prioritize) {
+    critical_path = std::make_unique<CriticalPath>(model, adg->numRobots());
+    prioritize_critical = prioritize;
+}
+
+void ExecutionState::enableEta(const DurationModel& model, std::function<double()> clock) {
+    eta_clock = std::move(clock);
+    eta_engine = std::make_unique<EtaEngine>(model);
+    eta_engine->reset(*this);
+}
+
+void ExecutionState::extensionBounds(std::vector<int>& first_unfinished, std::vector<int>& first_unreleased) const {
+    first_unfinished.resize(adg->numRobots());
+    first_unreleased.resize(adg->numRobots());
+    for (int i = 0; i < adg->numRobots(); i++) {
+        first_unfinished[i] = finished_node_idx[i] + 1;
+        first_unreleased[i] = firstUnreleased(i);
+    }
+}
+
+int ExecutionState::firstUnreleased(int robot_id) const {
+    int first = std::max(ready_frontier[robot_id], finished_node_idx[robot_id] + 1);
+    if (not enqueue_nodes_idx[robot_id].empty()) {
+        first = std::max(first, enqueue_nodes_idx[robot_id].back() + 1);
+    }
+    return first;
+}
+
+/*
+ * ADG::extend and ADG::compact keep the remaining edges of each node in their old order, so walking
+ * the old out-edges of a kept node and skipping those into dropped nodes pairs them with the new edge
+ * ids. Edges added by extend start valid.
+ */
+void ExecutionState::rebase(std::shared_ptr<const ADG> next) {
+    const ActionStore& old_actions = adg->actions();
+    const EdgeStore& old_edges = adg->edges();
+    const ActionStore& next_actions = next->actions();
+    const EdgeStore& next_edges = next->edges();
+    assert(next->numRobots() == adg->numRobots());
+    auto in_next = [&old_actions, &next](int v) {
+        return old_actions.nodeOf(v) >= next->firstNode(old_actions.agent_id[v]);
+    };
+
+    std::vector<std::atomic<uint64_t>> next_bits((next_edges.numEdges() + 63) / 64);
+    for (auto& bits: next_bits) {
+        bits.store(~uint64_t(0), std::memory_order_relaxed);
+    }
+    for (int v = 0; v < old_actions.size(); v++) {
+        if (not in_next(v)) {
+            continue;
+        }
+        int next_v = next_actions.index(old_actions.agent_id[v], old_actions.nodeOf(v));
+        int next_e = next_edges.outBegin(next_v);
+        for (int e = old_edges.outBegin(v); e < old_edges.outEnd(v); e++) {
+            if (not in_next(old_edges.target(e))) {
+                continue;
+            }
+            if (not isEdgeValid(e)) {
+                next_bits[next_e >> 6].fetch_and(~(uint64_t(1) << (next_e & 63)), std::memory_order_relaxed);
+            }
+            next_e++;
+        }
+    }
+    valid_bits.swap(next_bits);
+    if (eta_engine != nullptr) {
+        eta_engine->remap(adg->actions(), next->actions());
+    }
+    adg = std::move(next);
+
+    const EdgeStore& edge_store = adg->edges();
+    std::vector<int> deps(adg->numNodes(), 0);
+    for (int e = 0; e < edge_store.numEdges(); e++) {
+        if (isEdgeValid(e)) {
+            deps[edge_store.target(e)]++;
+        }
+    }
+    remaining_deps = std::vector<std::atomic<int>>(adg->numNodes());
+    for (int v = 0; v < adg->numNodes(); v++) {
+        remaining_deps[v].store(deps[v], std::memory_order_relaxed);
+    }
+    addDynamicDeps();
+    if (critical_path != nullptr) {
+        critical_path->graphChanged();
+    }
+    if (eta_engine != nullptr) {
+        eta_engine->recompute(*this);
+    }
+}
+
+void ExecutionState::addDynamicDeps() {
+    const ActionStore& action_store = adg->actions();
+    for (const auto& [source, targets]: dynamic_out) {
+        for (const auto& [agent, node]: targets) {
+            remaining_deps[action_store.index(agent, node)]++;
+        }
+    }
+}
+
+int ExecutionState::deadNodes() const {
+    int dead = 0;
+    for (int i = 0; i < adg->numRobots(); i++) {
+        int first_kept = std::min(finished_node_idx[i] + 1, adg->planSize(i) - 1);
+        dead += std::max(0, first_kept - adg->firstNode(i));
+    }
+    return dead;
+}
+
+bool ExecutionState::compact() {
+    if (deadNodes() == 0) {
+        return false;
+    }
+    // The last node stays, the plan extension of a finished agent starts from it.
+    std::vector<int> first_kept(adg->numRobots());
+    for (int i = 0; i < adg->numRobots(); i++) {
+        first_kept[i] = std::max(adg->firstNode(i), std::min(finished_node_idx[i] + 1, adg->planSize(i) - 1));
+    }
+    rebase(adg->compact(first_kept));
+    return true;
+}
+
+size_t ExecutionState::memoryBytes() const {
+    size_t bytes = sizeof(*this);
+    bytes += finished_node_idx.capacity() * sizeof(int) + ready_frontier.capacity() * sizeof(int);
+    bytes += remaining_deps.capacity() * sizeof(std::atomic<int>) +
+             valid_bits.capacity() * sizeof(std::atomic<uint64_t>);
+    for (const auto& enqueued: enqueue_nodes_idx) {
+        bytes += sizeof(enqueued) + enqueued.size() * sizeof(int);
+    }
+    for (const auto* dynamic: {&dynamic_out, &dynamic_in}) {
+        for (const auto& [key, nodes]: *dynamic) {
+            bytes += sizeof(key) + sizeof(nodes) + nodes.capacity() * sizeof(nodes[0]);
+        }
+    }
+    bytes += switched_orders.capacity() * sizeof(SwitchedOrder);
+    if (critical_path != nullptr) {
+        bytes += critical_path->memoryBytes();
+    }
+    if (eta_engine != nullptr) {
+        bytes += eta_engine->memoryBytes();
+    }
+    return bytes;
+}
+
+std::vector<Edge> ExecutionState::getIncomeEdges(int robot_id, int node_id) const {
+    const ActionStore& action_store = adg->actions();
+    const EdgeStore& edge_store = adg->edges();
+    std::vector<Edge> edges;
+    int v = action_store.index(robot_id, node_id);
+    for (int k = edge_store.inBegin(v); k < edge_store.inEnd(v); k++) {
+        int from = edge_store.inSource(k);
+        edges.emplace_back(action_store.agent_id[from], robot_id, action_store.nodeOf(from), node_id,
+                           isEdgeValid(edge_store.inEdge(k)));
+    }
+    return edges;
+}
+
+std::vector<Edge> ExecutionState::getOutEdges(int robot_id, int node_id) const {
+    const ActionStore& action_store = adg->actions();
+    const EdgeStore& edge_store = adg->edges();
+    std::vector<Edge> edges;
+    int v = action_store.index(robot_id, node_id);
+    for (int e = edge_store.outBegin(v); e < edge_store.outEnd(v); e++) {
+        int to = edge_store.target(e);
+        edges.emplace_back(robot_id, action_store.agent_id[to], node_id, action_store.nodeOf(to),
+                           isEdgeValid(e));
+    }
+    return edges;
+}
+
+bool ExecutionState::hasWaiters(int idx) const {
+    const EdgeStore& edge_store = adg->edges();
+    for (int e = edge_store.outBegin(idx); e < edge_store.outEnd(idx); e++) {
+        if (isEdgeValid(e)) {
+            return true;
+        }
+    }
+    const ActionStore& action_store = adg->actions();
+    return not dynamic_out.empty() and
+           dynamic_out.count(nodeKey(action_store.agent_id[idx], action_store.nodeOf(idx))) > 0;
+}
+
+int ExecutionState::advanceReadyFrontier(int robot_id) {
+    const ActionStore& action_store = adg->actions();
+    int& frontier = ready_frontier[robot_id];
+    frontier = std::max(frontier, finished_node_idx[robot_id] + 1);
+    int plan_size = action_store.planSize(robot_id);
+    while (frontier < plan_size and
+           remaining_deps[action_store.index(robot_id, frontier)].load(std::memory_order_acquire) == 0) {
+        frontier++;
+    }
+    return frontier;
+}
+
+// Only nodes that became ready since the last poll are visited.
+bool ExecutionState::getAvailableNodes(int robot_id, std::vector<int>& available_nodes) {
+    std::unique_lock<std::mutex> eta_lock;
+    if (eta_engine != nullptr and (platoon_gap > 0.0 or switch_edges)) {
+        eta_lock = std::unique_lock<std::mutex>(eta_mutex);
+    }
+    int frontier = advanceReadyFrontier(robot_id);
+    // Switching is tried once per blocked node, when the frontier first stops there.
+    while (switch_edges and frontier < adg->planSize(robot_id) and switch_tried[robot_id] != frontier) {
+        switch_tried[robot_id] = frontier;
+        if (not switchBlockingEdges(adg->actions().index(robot_id, frontier))) {
+            break;
+        }
+        frontier = advanceReadyFrontier(robot_id);
+    }
+    int first_new = finished_node_idx[robot_id] + 1;
+    if (not enqueue_nodes_idx[robot_id].empty()) {
+        first_new = std::max(first_new, enqueue_nodes_idx[robot_id].back() + 1);
+    }
+    for (int i = first_new; i < frontier; i++) {
+        available_nodes.push_back(i);
+        if (platoon_gap > 0.0) {
+            releaseFollowers(adg->actions().index(robot_id, i));
+        }
+    }
+    if (eta_engine != nullptr and platoon_gap > 0.0) {
+        eta_engine->propagate(*this);
+    }
+    return true;
+}
+
+/*
+ * The moves X of the agent of released that lie in one straight run up to it, and whose start is the
+ * first one left at least platoon_gap behind its goal, drop their edges to followers moving the same way.
+ * Moves further back got within the gap when an earlier node was released.
+ */
+void ExecutionState::releaseFollowers(int released) {
+    const ActionStore& actions = adg->actions();
+    const EdgeStore& edge_store = adg->edges();
+    int dx = actions.goal_x[released] - actions.start_x[released];
+    int dy = actions.goal_y[released] - actions.start_y[released];
+    if (dx == 0 and dy == 0) {
+        return;
+    }
+    auto same_direction = [&actions, dx, dy](int v) {
+        return actions.goal_x[v] - actions.start_x[v] == dx and actions.goal_y[v] - actions.start_y[v] == dy;
+    };
+    double gap = platoon_gap * actions.cell_units;
+    int step = std::abs(dx) + std::abs(dy);
+    int agent = actions.agent_id[released];
+    for (int x = released; x >= actions.node_offset[agent] and same_direction(x); x--) {
+        int ahead = std::abs(actions.goal_x[released] - actions.start_x[x]) +
+                    std::abs(actions.goal_y[released] - actions.start_y[x]);
+        if (x != released and ahead - step >= gap) {
+            break;
+        }
+        if (ahead < gap) {
+            continue;
+        }
+        for (int e = edge_store.outBegin(x); e < edge_store.outEnd(x); e++) {
+            int follower = edge_store.target(e);
+            if (isEdgeValid(e) and same_direction(follower)) {
+                invalidateEdge(e);
+                remaining_deps[follower]--;
+                platoon_releases++;
+                if (eta_engine != nullptr) {
+                    eta_engine->touch(follower);
+                }
+            }
+        }
+    }
+}
+
+bool ExecutionState::updateFinishedNode(int robot_id, int node_id) {
+    const ActionStore& action_store = adg->actions();
+    const EdgeStore& edge_store = adg->edges();
+    int latest_finished_idx = finished_node_idx[robot_id];
+    if (node_id <= latest_finished_idx) {
+        std::cerr << "Reconfirming nodes!" << std::endl;
+        return true;
+    } else {
+        if (not enqueue_nodes_idx[robot_id].empty() and node_id > enqueue_nodes_idx[robot_id].back()) {
+            std::cerr << "Confirm for nodes never enqueue!" << std::endl;
+            return false;
+        } else {
+            std::unique_lock<std::mutex> eta_lock;
+            if (eta_engine != nullptr) {
+                eta_lock = std::unique_lock<std::mutex>(eta_mutex);
+            }
+            double now = eta_engine != nullptr ? eta_clock() : 0.0;
+            for (int tmp_idx = latest_finished_idx+1; tmp_idx <= node_id; tmp_idx++) {
+                int v = action_store.index(robot_id, tmp_idx);
+                assert(remaining_deps[v] == 0);
+                if (eta_engine != nullptr) {
+                    eta_engine->nodeFinished(*this, v, now);
+                }
+
+                for (int e = edge_store.outBegin(v); e < edge_store.outEnd(v); e++) {
+                    if (isEdgeValid(e)) {
+                        invalidateEdge(e);
+                        remaining_deps[edge_store.target(e)].fetch_sub(1, std::memory_order_release);
+                    }
+                }
+                if (not dynamic_out.empty()) {
+                    auto dynamic = dynamic_out.find(nodeKey(robot_id, tmp_idx));
+                    if (dynamic != dynamic_out.end()) {
+                        for (const auto& [agent, node]: dynamic->second) {
+                            remaining_deps[action_store.index(agent, node)]--;
+                        }
+                        dynamic_out.erase(dynamic);
+                    }
+                }
+                if (not dynamic_in.empty()) {
+                    dynamic_in.erase(nodeKey(robot_id, tmp_idx));
+                }
+            }
+            finished_node_idx[robot_id] = node_id;
+            if (critical_path != nullptr) {
+                critical_path->nodesFinished(node_id - latest_finished_idx);
+            }
+            if (eta_engine != nullptr) {
+                eta_engine->propagate(*this);
+            }
+            while(not enqueue_nodes_idx[robot_id].empty()) {
+                if (enqueue_nodes_idx[robot_id].front() <= node_id) {
+                    enqueue_nodes_idx[robot_id].pop_front();
+                } else {
+                    break;
+                }
+            }
+            return true;
+        }
+    }
+}
+
+bool ExecutionState::switchBlockingEdges(int blocked) {
+    const EdgeStore& edge_store = adg->edges();
+    for (int k = edge_store.inBegin(blocked); k < edge_store.inEnd(blocked) and remaining_deps[blocked] > 0; k++) {
+        if (isEdgeValid(edge_store.inEdge(k))) {
+            switchEdge(k, blocked);
+        }
+    }
+    return remaining_deps[blocked] == 0;
+}
+
+/*
+ * Edge X -> Y orders agent a leaving point p (X) before agent b enters it (Y). To let b go first,
+ * a must not be released into p yet: its entering node E, the move before X that ends at p, is not
+ * released. b then leaves p at L, its first move after Y that starts at p, and E waits for L instead.
+ * Turns in place at p are skipped on both sides. If Y itself is a turn, b already stands on p.
+ */
+bool ExecutionState::switchEdge(int in_slot, int blocked) {
+    const ActionStore& actions = adg->actions();
+    const EdgeStore& edge_store = adg->edges();
+    auto in_place = [&actions](int v) {
+        return actions.start_x[v] == actions.goal_x[v] and actions.start_y[v] == actions.goal_y[v];
+    };
+    int edge = edge_store.inEdge(in_slot);
+    int x = edge_store.inSource(in_slot);
+    int agent_a = actions.agent_id[x];
+    int agent_b = actions.agent_id[blocked];
+    if (in_place(blocked)) {
+        return false;
+    }
+    int enter = x - 1;
+    while (enter >= actions.node_offset[agent_a] and in_place(enter)) {
+        enter--;
+    }
+    if (enter < actions.node_offset[agent_a] or actions.nodeOf(enter) < firstUnreleased(agent_a)) {
+        return false;
+    }
+    int leave = blocked + 1;
+    while (leave < actions.node_offset[agent_b+1] and in_place(leave)) {
+        leave++;
+    }
+    if (leave >= actions.node_offset[agent_b+1]) {
+        return false;
+    }
+    // Agent a stays first if it is the more critical one.
+    if (prioritize_critical and
+        critical_path->slack(*this, blocked) > critical_path->slack(*this, enter)) {
+        return false;
+    }
+    if (reaches(enter, leave, edge)) {
+        return false;
+    }
+
+    invalidateEdge(edge);
+    remaining_deps[blocked]--;
+    dynamic_out[nodeKey(agent_b, actions.nodeOf(leave))].emplace_back(agent_a, actions.nodeOf(enter));
+    dynamic_in[nodeKey(agent_a, actions.nodeOf(enter))].emplace_back(agent_b, actions.nodeOf(leave));
+    remaining_deps[enter]++;
+    switched_orders.push_back({actions.goalPoint(blocked), agent_b, actions.nodeOf(blocked),
+                               agent_a, actions.nodeOf(x)});
+    if (eta_engine != nullptr) {
+        eta_engine->touch(blocked);
+        eta_engine->touch(enter);
+        eta_engine->propagate(*this);
+    }
+    return true;
+}
+
+/*
+ * Whether to is reachable from from over unfinished nodes, ignoring skipped_edge. Type-1 and type-2
+ * edges never lead to an earlier action, only switched edges do, by at most their start time gap, so
+ * nodes starting later than to plus all those gaps are pruned. Searches past MAX_VISITED nodes give up
+ * and answer true, which keeps the order.
+ */
+bool ExecutionState::reaches(int from, int to, int skipped_edge) const {
+    static constexpr size_t MAX_VISITED = 1 << 12;
+    const ActionStore& actions = adg->actions();
+    double latest = actions.time[to];
+    for (const auto& [source, targets]: dynamic_out) {
+        int source_idx = actions.index(static_cast<int>(source >> 32), static_cast<int>(source & 0xffffffff));
+        for (const auto& [agent, node]: targets) {
+            latest += std::max(0.0, actions.time[source_idx] - actions.time[actions.index(agent, node)]);
+        }
+    }
+
+    std::unordered_set<int> visited {from};
+    std::vector<int> stack {from};
+    auto visit = [&](int w) {
+        if (actions.nodeOf(w) > finished_node_idx[actions.agent_id[w]] and actions.time[w] <= latest and
+            visited.insert(w).second) {
+            stack.push_back(w);
+        }
+    };
+    while (not stack.empty()) {
+        int v = stack.back();
+        stack.pop_back();
+        if (v == to) {
+            return true;
+        }
+        if (visited.size() > MAX_VISITED) {
+            return true;
+        }
+        forEachSuccessor(v, visit, skipped_edge);
+    }
+    return false;
+}
+
+void ExecutionState::setEnqueueNodes(int robot_id, std::vector<int>& enqueue_nodes) {
+    auto& curr_enqueue = enqueue_nodes_idx[robot_id];
+    if (curr_enqueue.empty()) {
+        curr_enqueue.insert(curr_enqueue.end(), enqueue_nodes.begin(), enqueue_nodes.end());
+    } else {
+        int i = 0;
+        for (i = 0; i < enqueue_nodes.size(); i++) {
+            if (enqueue_nodes[i] > curr_enqueue.back()) {
+                break;
+            }
+        }
+        curr_enqueue.insert(curr_enqueue.end(), enqueue_nodes.begin()+i, enqueue_nodes.end());
+    }
+}
+
+void ExecutionState::findConstraining(int robot_id) {
+    int i = advanceReadyFrontier(robot_id);
+    if (i < adg->planSize(robot_id)) {
+        std::cout << "Constraining idx: " << i << ";";
+        for (const auto& tmp_edge: getIncomeEdges(robot_id, i)) {
+            if (tmp_edge.valid) {
+                std::cout << " Constraint Agent " << tmp_edge.from_agent_id << " at node " << tmp_edge.from_node_id << ";";
+            }
+        }
+    }
+}
+
+void ExecutionState::printProgress()
+{
+    for (int agent_id = 0; agent_id < adg->numRobots(); agent_id++) {
+        std::cout << "Agent " << agent_id << ", ID: " << adg->robotName(agent_id) << " with plan size " << adg->planSize(agent_id) << ": ";
+        findConstraining(agent_id);
+        for (int i = 0; i <= finished_node_idx[agent_id]; i++) {
+            std::cout << "#";
+        }
+        for (auto elem: enqueue_nodes_idx[agent_id]) {
+            std::cout << '0';
+        }
+        int unstart;
+        if (enqueue_nodes_idx[agent_id].empty()) {
+            unstart = finished_node_idx[agent_id];
+        } else {
+            unstart = enqueue_nodes_idx[agent_id].back();
+        }
+        for (int i = unstart+1; i < adg->planSize(agent_id); i++) {
+            std::cout << "*";
+        }
+        std::cout << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+SIM_PLAN ExecutionState::getPlan(int agent_id) {
+    const ActionStore& action_store = adg->actions();
+    SIM_PLAN sim_plan;
+    std::vector<int> enque_acts;
+    getAvailableNodes(agent_id, enque_acts);
+    for (int enque_id: enque_acts) {
+        int idx = action_store.index(agent_id, enque_id);
+        sim_plan.emplace_back(adg->robotName(agent_id), enque_id, action_store.orientation(idx),
+                              std::string(1, action_store.robotType(idx)), action_store.startPoint(idx), action_store.goalPoint(idx));
+        enqueue_nodes_idx[agent_id].push_back(enque_id);
+    }
+    return sim_plan;
+}
@@ -15,7 +15,8 @@ int getOrientation(int x1, int y1, int x2, int y2) {
     }
 }
 
-void processAgentActions(const vector<Point>& points, vector<Step>& steps, bool flipped_coord) {
+void processAgentActions(const vector<Point>& points, vector<Step>& steps, bool flipped_coord,
+                         bool reverse_moves = false) {
     steps.clear();
     int currentOrientation = 0;
     double currentTime = 0;
@@ -33,18 +34,20 @@ void processAgentActions(const vector<Point>& points, vector<Step>& steps, bool
                 neededOrientation = currentOrientation;
             }
 
-            if (neededOrientation != currentOrientation) {
+            bool reverse = reverse_moves and neededOrientation == (currentOrientation + 2) % 4;
+            if (neededOrientation != currentOrientation and not reverse) {
                 steps.push_back({points[i-1].x, points[i-1].y, neededOrientation, currentTime});
                 currentOrientation = neededOrientation;
             }
-            steps.push_back({points[i].x, points[i].y, currentOrientation, ++currentTime});
+            steps.push_back({points[i].x, points[i].y, currentOrientation, ++currentTime, reverse});
         }
     }
 }
 
-void processAgentActionsContinuous(const vector<Point>& points, vector<Step>& steps, bool flipped_coord) {
+void processAgentActionsContinuous(const vector<Point>& points, vector<Step>& steps, bool flipped_coord,
+                                   int start_orientation = 0, bool reverse_moves = false) {
     steps.clear();
-    int currentOrientation = 0;
+    int currentOrientation = start_orientation;
     double currentTime = 0.0;
     for (size_t i = 0; i < points.size(); ++i) {
         if (i == 0) {
@@ -60,12 +63,13 @@ void processAgentActionsContinuous(const vector<Point>& points, vector<Step>& st
                 neededOrientation = currentOrientation;
             }
 
-            if (neededOrientation != currentOrientation) {
+            bool reverse = reverse_moves and neededOrientation == (currentOrientation + 2) % 4;
+            if (neededOrientation != currentOrientation and not reverse) {
                 steps.push_back({points[i-1].x, points[i-1].y, neededOrientation, currentTime});
                 currentOrientation = neededOrientation;
             }
             currentTime = points[i].time;
-            steps.push_back({points[i].x, points[i].y, currentOrientation, currentTime});
+            steps.push_back({points[i].x, points[i].y, currentOrientation, currentTime, reverse});
         }
     }
 }
@@ -101,7 +105,9 @@ vector<Point> parseLine(const string& line) {
     return points;
 }
 
-vector<Point> parseLineContinuous(const string& line) {
+// A jump between cells that are not adjacent ends the program, unless valid is given: it is then
+// cleared and the points up to the jump are returned.
+vector<Point> parseLineContinuous(const string& line, bool* valid = nullptr) {
     vector<Point> points;
     stringstream ss(line);
     char ignore;
@@ -118,6 +124,10 @@ vector<Point> parseLineContinuous(const string& line) {
             first_loc = false;
         }
         if (std::abs(prev_x - x) + std::abs(prev_y - y) >= 2) {
+            if (valid != nullptr) {
+                *valid = false;
+                return points;
+            }
             raiseError("Invalid Plan");
         }
         points.push_back({x, y, t});
@@ -129,7 +139,8 @@ vector<Point> parseLineContinuous(const string& line) {
     return points;
 }
 
-std::vector<std::vector<Action>> processActions(const std::vector<std::vector<Step>>& raw_steps, bool flipped_coord) {
+std::vector<std::vector<Action>> processActions(const std::vector<std::vector<Step>>& raw_steps, bool flipped_coord,
+                                                int move_splits) {
     std::vector<std::vector<Action>> plans;
     int node_id=0;
     for (size_t i = 0; i < raw_steps.size(); ++i) {
@@ -156,26 +167,26 @@ std::vector<std::vector<Action>> processActions(const std::vector<std::vector<St
             processedAction.goal.second = curr_step_y;
             processedAction.orientation = raw_steps[i][j].orientation;
             processedAction.nodeID = node_id;
-            Action accesoray_action = processedAction;
 
             if (processedAction.start == processedAction.goal &&
                 raw_steps[i][j-1].orientation != raw_steps[i][j].orientation) {
                 processedAction.type = 'T';
             } else if (processedAction.start != processedAction.goal &&
                         raw_steps[i][j-1].orientation == raw_steps[i][j].orientation) {
-                double mid_x = (prev_step_x + curr_step_x)/2.0;
-                double mid_y = (prev_step_y + curr_step_y)/2.0;
+                // A move becomes move_splits equal sub-actions, each a node of its own.
                 processedAction.type = 'M';
-                processedAction.start.first = prev_step_x;
-                processedAction.start.second = prev_step_y;
-                processedAction.goal.first = mid_x;
-                processedAction.goal.second = mid_y;
-                accesoray_action.type = 'M';
-                accesoray_action.start.first = mid_x;
-                accesoray_action.start.second = mid_y;
-                accesoray_action.goal.first = curr_step_x;
-                accesoray_action.goal.second = curr_step_y;
-                accesoray_action.nodeID = node_id+1;
+                for (int s = 0; s < move_splits; s++) {
+                    Action sub_action = processedAction;
+                    sub_action.start.first = prev_step_x + (curr_step_x - prev_step_x) * s / move_splits;
+                    sub_action.start.second = prev_step_y + (curr_step_y - prev_step_y) * s / move_splits;
+                    sub_action.goal.first = prev_step_x + (curr_step_x - prev_step_x) * (s + 1) / move_splits;
+                    sub_action.goal.second = prev_step_y + (curr_step_y - prev_step_y) * (s + 1) / move_splits;
+                    sub_action.nodeID = node_id + s;
+                    sub_action.reverse = raw_steps[i][j].reverse;
+                    processedActions.push_back(sub_action);
+                }
+                node_id += move_splits;
+                continue;
             } else if (processedAction.start == processedAction.goal &&
                        raw_steps[i][j-1].orientation == raw_steps[i][j].orientation) {
                 continue;
@@ -187,11 +198,18 @@ std::vector<std::vector<Action>> processActions(const std::vector<std::vector<St
             if (processedAction.type == 'T' and j == (raw_steps[i].size()-1)) {
                 continue;
             }
-            processedActions.push_back(processedAction);
-            if (processedAction.type == 'M') {
-                processedActions.push_back(accesoray_action);
-                node_id++;
+            if (processedAction.type == 'T' and not processedActions.empty() and processedActions.back().type == 'T') {
+                // Only the final heading of turns in place matters; drop them if they cancel out.
+                processedActions.back().orientation = processedAction.orientation;
+                int heading_before = processedActions.size() > 1 ?
+                    static_cast<int>(processedActions[processedActions.size() - 2].orientation) : raw_steps[i][0].orientation;
+                if (static_cast<int>(processedAction.orientation) == heading_before) {
+                    processedActions.pop_back();
+                    node_id--;
+                }
+                continue;
             }
+            processedActions.push_back(processedAction);
             node_id++;
         }
         plans.push_back(processedActions);
@@ -199,6 +217,28 @@ std::vector<std::vector<Action>> processActions(const std::vector<std::vector<St
     return plans;
 }
 
+bool parseSegment(const std::string& line, int robot_id, int start_orientation, bool flipped_coord,
+                  std::vector<Action>& actions, int move_splits, bool reverse_moves) {
+    // A running server must survive a malformed extension, so it is rejected rather than fatal.
+    bool valid = true;
+    vector<Point> points = parseLineContinuous(line, &valid);
+    if (not valid or points.empty()) {
+        return false;
+    }
+    for (size_t i = 1; i < points.size(); i++) {
+        if (points[i].time < points[i-1].time) {
+            return false;
+        }
+    }
+    std::vector<std::vector<Step>> raw_plan(1);
+    processAgentActionsContinuous(points, raw_plan[0], flipped_coord, start_orientation, reverse_moves);
+    actions = processActions(raw_plan, flipped_coord, move_splits)[0];
+    for (auto& action: actions) {
+        action.robot_id = robot_id;
+    }
+    return true;
+}
+
 void showStepPoints(std::vector<std::vector<Step>>& raw_plan){
     for (size_t i = 0; i < raw_plan.size(); i++) {
         printf("Path of agent: %lu\n", i);
@@ -235,7 +275,9 @@ bool parseEntirePlan(const std::string& input_file,
                      std::vector<std::vector<Action>>& plans,
                      double& raw_cost,
                      bool flipped_coord,
-                     PlanType file_type){
+                     PlanType file_type,
+                     int move_splits,
+                     bool reverse_moves){
     plans.clear();
     ifstream inFile(input_file);
     if (!inFile.is_open()) {
@@ -253,13 +295,13 @@ bool parseEntirePlan(const std::string& input_file,
             if (!line.empty()) {
                 std::vector<Point> points = parseLine(line);
                 raw_cost += static_cast<double> (points.size());
-                processAgentActions(points, tmp_plan, flipped_coord);
+                processAgentActions(points, tmp_plan, flipped_coord, reverse_moves);
                 agentId++;
             }
             raw_plan.push_back(tmp_plan);
         }
         inFile.close();
-        plans = processActions(raw_plan, flipped_coord);
+        plans = processActions(raw_plan, flipped_coord, move_splits);
         return true;
     } else if (file_type == CONTINUOUS) {
         std::vector<std::vector<Step>> raw_plan;
@@ -271,14 +313,14 @@ bool parseEntirePlan(const std::string& input_file,
             if (!line.empty()) {
                 vector<Point> points = parseLineContinuous(line);
                 raw_cost += static_cast<double> (points.back().time);
-                processAgentActionsContinuous(points, tmp_plan, flipped_coord);
+                processAgentActionsContinuous(points, tmp_plan, flipped_coord, 0, reverse_moves);
                 agentId++;
             }
             raw_plan.push_back(tmp_plan);
         }
         inFile.close();
         // showStepPoints(raw_plan);
-        plans = processActions(raw_plan, flipped_coord);
+        plans = processActions(raw_plan, flipped_coord, move_splits);
         // showActionsPlan(plans);
         return true;
     } else {
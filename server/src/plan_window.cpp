@@ -0,0 +1,87 @@
+#include "plan_window.h"
+
+PlanWindow::PlanWindow(double window, std::vector<std::vector<Action>>& plans, int cell_units): window(window) {
+    next_pending.assign(plans.size(), 0);
+    // The first window covers the first action of every agent, which the ADG names the robots after.
+    double first_time = -std::numeric_limits<double>::infinity();
+    for (const auto& plan: plans) {
+        if (not plan.empty()) {
+            first_time = std::max(first_time, plan.front().time);
+        }
+    }
+    horizon_time = first_time + window;
+    std::vector<std::vector<Action>> tails(plans.size());
+    for (size_t i = 0; i < plans.size(); i++) {
+        // Action times never decrease along a plan, so the materialized part is a prefix.
+        auto split = std::find_if(plans[i].begin(), plans[i].end(), [this](const Action& action) {
+            return action.time >= horizon_time;
+        });
+        tails[i].assign(split, plans[i].end());
+        pending_count += static_cast<long>(tails[i].size());
+        plans[i].erase(split, plans[i].end());
+        plans[i].shrink_to_fit();
+    }
+    pending.build(tails, cell_units);
+}
+
+void PlanWindow::append(const std::vector<std::vector<Action>>& segments) {
+    pending.append(segments);
+    for (const auto& segment: segments) {
+        pending_count += static_cast<long>(segment.size());
+    }
+    appended = true;
+}
+
+double PlanWindow::slowestAgentTime(const ExecutionState& execution) const {
+    const ActionStore& actions = execution.graph().actions();
+    double slowest = std::numeric_limits<double>::infinity();
+    for (int i = 0; i < execution.graph().numRobots(); i++) {
+        int next_node = execution.finished_node_idx[i] + 1;
+        if (next_node < actions.planSize(i)) {
+            slowest = std::min(slowest, actions.time[actions.index(i, next_node)]);
+        } else if (hasPending(i)) {
+            slowest = std::min(slowest, pending.time[pending.index(i, next_pending[i])]);
+        }
+    }
+    return slowest;
+}
+
+bool PlanWindow::advance(ExecutionState& execution) {
+    if (pending_count == 0) {
+        return false;
+    }
+    double target = horizon_time;
+    double slowest = slowestAgentTime(execution);
+    if (slowest + window / 2.0 > horizon_time) {
+        target = slowest + window;
+    }
+    if (target == horizon_time and not appended) {
+        return false;
+    }
+    horizon_time = target;
+    appended = false;
+
+    std::vector<std::vector<Action>> segments(next_pending.size());
+    int moved = 0;
+    for (size_t i = 0; i < next_pending.size(); i++) {
+        int agent = static_cast<int>(i);
+        while (hasPending(agent) and pending.time[pending.index(agent, next_pending[i])] < horizon_time) {
+            segments[i].push_back(pending.action(pending.index(agent, next_pending[i])));
+            next_pending[i]++;
+            moved++;
+        }
+    }
+    if (moved == 0) {
+        return false;
+    }
+    pending_count -= moved;
+    handed_over += moved;
+    if (handed_over > pending_count) {
+        pending.dropBefore(next_pending);
+        handed_over = 0;
+    }
+    std::vector<int> first_unfinished, first_unreleased;
+    execution.extensionBounds(first_unfinished, first_unreleased);
+    execution.rebase(execution.graph().extend(segments, first_unfinished, first_unreleased));
+    return true;
+}
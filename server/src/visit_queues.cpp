@@ -0,0 +1,123 @@
+#include "visit_queues.h"
+
+VisitQueueState::VisitQueueState(std::shared_ptr<const ADG> adg): adg(std::move(adg)) {
+    const ActionStore& actions = this->adg->actions();
+    CellIndex cell_index;
+    cell_index.build(actions);
+    leaving = std::move(cell_index.leaving);
+    enter_point.assign(actions.size(), -1);
+    shared_leave.assign(actions.size(), 0);
+    for (const auto& cell: cell_index.cells) {
+        int point = static_cast<int>(point_begin.size());
+        point_begin.push_back(cell.leave_begin);
+        point_end.push_back(cell.leave_end);
+        for (int e = cell.enter_begin; e < cell.enter_end; e++) {
+            enter_point[cell_index.entering[e]] = point;
+        }
+        // The only agent entering the point, or -1 once a second one shows up.
+        int entering_agent = actions.agent_id[cell_index.entering[cell.enter_begin]];
+        for (int e = cell.enter_begin; e < cell.enter_end; e++) {
+            if (actions.agent_id[cell_index.entering[e]] != entering_agent) {
+                entering_agent = -1;
+                break;
+            }
+        }
+        for (int k = cell.leave_begin; k < cell.leave_end; k++) {
+            shared_leave[leaving[k]] = actions.agent_id[leaving[k]] != entering_agent;
+        }
+    }
+    cursor = point_begin;
+
+    int num_robots = this->adg->numRobots();
+    finished_node_idx.assign(num_robots, -1);
+    enqueue_nodes_idx.assign(num_robots, {});
+    ready_frontier.assign(num_robots, 0);
+}
+
+bool VisitQueueState::isFinished(int idx) const {
+    const ActionStore& actions = adg->actions();
+    return actions.nodeOf(idx) <= finished_node_idx[actions.agent_id[idx]];
+}
+
+bool VisitQueueState::isReady(int idx) {
+    int point = enter_point[idx];
+    if (point < 0) {
+        return true;
+    }
+    const ActionStore& actions = adg->actions();
+    int& first = cursor[point];
+    while (first < point_end[point] and isFinished(leaving[first])) {
+        first++;
+    }
+    int agent = actions.agent_id[idx];
+    for (int k = first; k < point_end[point] and actions.time[leaving[k]] <= actions.time[idx]; k++) {
+        int leave = leaving[k];
+        int leave_agent = actions.agent_id[leave];
+        if (leave_agent == agent or isFinished(leave)) {
+            continue;
+        }
+        // As in matchEnteringActions, on a tie a smaller agent swapping cells with the leaving one goes first.
+        if (actions.time[leave] == actions.time[idx] and agent < leave_agent and
+            actions.start_x[idx] == actions.goal_x[leave] and actions.start_y[idx] == actions.goal_y[leave]) {
+            continue;
+        }
+        return false;
+    }
+    return true;
+}
+
+int VisitQueueState::advanceReadyFrontier(int robot_id) {
+    const ActionStore& actions = adg->actions();
+    int& frontier = ready_frontier[robot_id];
+    frontier = std::max(frontier, finished_node_idx[robot_id] + 1);
+    int plan_size = actions.planSize(robot_id);
+    while (frontier < plan_size and isReady(actions.index(robot_id, frontier))) {
+        frontier++;
+    }
+    return frontier;
+}
+
+bool VisitQueueState::updateFinishedNode(int robot_id, int node_id) {
+    if (node_id <= finished_node_idx[robot_id]) {
+        std::cerr << "Reconfirming nodes!" << std::endl;
+        return true;
+    }
+    auto& enqueued = enqueue_nodes_idx[robot_id];
+    if (not enqueued.empty() and node_id > enqueued.back()) {
+        std::cerr << "Confirm for nodes never enqueue!" << std::endl;
+        return false;
+    }
+    finished_node_idx[robot_id] = node_id;
+    while (not enqueued.empty() and enqueued.front() <= node_id) {
+        enqueued.pop_front();
+    }
+    return true;
+}
+
+SIM_PLAN VisitQueueState::getPlan(int agent_id) {
+    const ActionStore& actions = adg->actions();
+    int frontier = advanceReadyFrontier(agent_id);
+    int first_new = finished_node_idx[agent_id] + 1;
+    if (not enqueue_nodes_idx[agent_id].empty()) {
+        first_new = std::max(first_new, enqueue_nodes_idx[agent_id].back() + 1);
+    }
+    SIM_PLAN sim_plan;
+    for (int node = first_new; node < frontier; node++) {
+        int idx = actions.index(agent_id, node);
+        sim_plan.emplace_back(adg->robotName(agent_id), node, actions.orientation(idx),
+                              std::string(1, actions.robotType(idx)), actions.startPoint(idx), actions.goalPoint(idx));
+        enqueue_nodes_idx[agent_id].push_back(node);
+    }
+    return sim_plan;
+}
+
+size_t VisitQueueState::memoryBytes() const {
+    size_t bytes = sizeof(*this);
+    bytes += (leaving.capacity() + enter_point.capacity()) * sizeof(int) + shared_leave.capacity();
+    bytes += (point_begin.capacity() + point_end.capacity() + cursor.capacity()) * sizeof(int);
+    bytes += (finished_node_idx.capacity() + ready_frontier.capacity()) * sizeof(int);
+    for (const auto& enqueued: enqueue_nodes_idx) {
+        bytes += sizeof(enqueued) + enqueued.size() * sizeof(int);
+    }
+    return bytes;
+}